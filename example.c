@@ -2,13 +2,17 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 
 #if WITH_LIBUV
@@ -17,6 +21,21 @@
 
 #include "scm.h"
 #include "memorywheel.h"
+#include "memorywheel_chain.h"
+#include "memorywheel_spill.h"
+#include "memorywheel_lanes.h"
+#include "memorywheel_ring.h"
+#include "memorywheel_slots.h"
+#include "memorywheel_pack.h"
+#include "memorywheel_lossy.h"
+#include "memorywheel_latest.h"
+#include "memorywheel_pool.h"
+#include "memorywheel_fill.h"
+#include "memorywheel_mpsc.h"
+#include "memorywheel_bcast.h"
+#include "memorywheel_tap.h"
+#include "memorywheel_mpmc.h"
+#include "memorywheel_percpu.h"
 
 /* the sock tests are also limited by the socket buffer
  * because of SOCK_SEQPACKET (sysctl net.core.wmem_max) */
@@ -24,6 +43,51 @@
 #define SEND_SIZE_MAX  ((uint64_t)         16)
 #define MAGIC          ("¯\\_(ツ)_/¯")
 #define NLOOPS         (1000 * 1000 * 1)
+/* most messages made or shared at once in the batch mode */
+#define BATCH_MAX      (64)
+/* the chain mode starts with a small primary segment and overflows into more
+ * of the same size up to WHEEL_SIZE in total */
+#define CHAIN_SEG_SIZE (WHEEL_SIZE / 8)
+/* the spill mode's receiver stops this long every SPILL_PAUSE_EVERY messages,
+ * the sender spills to a file meanwhile */
+#define SPILL_PAUSE_NS    (20 * 1000 * 1000)
+#define SPILL_PAUSE_EVERY (NLOOPS / 10)
+/* the lanes mode sends every LANES_URGENT_EVERY message in a small lane 0,
+ * the rest in lane 1 */
+#define LANES_URGENT_SIZE  (WHEEL_SIZE / 8)
+#define LANES_URGENT_EVERY 64
+/* descriptors for the ring mode, the arena is the rest of WHEEL_SIZE */
+#define RING_SLOTS         1024
+/* every message in the slots mode is this big */
+#define SLOTS_SIZE         32
+/* how big the pack mode makes each frame of records */
+#define PACK_FRAME_SIZE    1024
+/* the lossy mode's receiver stops for SPILL_PAUSE_NS every LOSSY_PAUSE_EVERY
+ * messages it gets, the sender writes over what it hasn't read meanwhile */
+#define LOSSY_PAUSE_EVERY  (NLOOPS / 100)
+/* the pool mode's receiver reads with this many threads, one of them sleeps
+ * for POOL_SLOW_NS on every POOL_SLOW_EVERY-th message so the rest return out
+ * of order around it */
+#define POOL_WORKERS       4
+#define POOL_SLOW_EVERY    1000
+#define POOL_SLOW_NS       (50 * 1000)
+/* the fill mode's sender writes messages with this many threads */
+#define FILL_WORKERS       4
+/* the mpsc mode's sender sends NLOOPS messages split over rounds with one
+ * producer thread, then two, and so on up to this many */
+#define MPSC_PRODUCERS_MAX 32
+/* the bcast mode's receiver forks into this many consumers */
+#define BCAST_CONSUMERS    4
+/* the mpmc mode sends with this many producer threads and its receiver forks
+ * into this many consumers, the shards mode pairs each producer with one
+ * consumer on its own whl_t of WHEEL_SIZE / MPMC_THREADS */
+#define MPMC_THREADS       4
+/* how long an mpmc consumer waits before looking if the others got the last
+ * messages */
+#define MPMC_WAIT_MS       100
+/* the percpu mode's sender sends with this many producer threads into a
+ * wheel for each cpu */
+#define PERCPU_PRODUCERS   8
 
 #define NANOS_PER_SEC 1000000000
 
@@ -56,6 +120,25 @@ typedef enum tport_e {
 	TPORT_SPIN,
 	TPORT_LIBUV,
 	TPORT_SEQPACKET,
+	TPORT_SPLIT,
+	TPORT_BATCH,
+	TPORT_MIRROR,
+	TPORT_CHAIN,
+	TPORT_SPILL,
+	TPORT_LANES,
+	TPORT_RING,
+	TPORT_SLOTS,
+	TPORT_PACK,
+	TPORT_LOSSY,
+	TPORT_LATEST,
+	TPORT_POOL,
+	TPORT_FILL,
+	TPORT_MPSC,
+	TPORT_BCAST,
+	TPORT_TAP,
+	TPORT_MPMC,
+	TPORT_SHARDS,
+	TPORT_PERCPU,
 	__TPORT_COUNT,
 } tport_t;
 
@@ -80,6 +163,10 @@ xorshiftr128plus(xorshiftr128plus_t *state)
 
 const xorshiftr128plus_t rng_init = { 420, 69 };
 
+/* what the sender initializes the wheel with, the receiver reads it from the
+ * wheel's header */
+size_t slice_align = WHL_ALIGN;
+
 err_t
 open_memfd(int *memfd)
 {
@@ -115,6 +202,45 @@ close_shm(char *shm)
 		return YIPPIE;
 }
 
+/* like `open_shm` but then maps everything after the first page again right
+ * after it, for `whl_init_mirrored()` */
+err_t
+open_mirror_shm(int memfd, char **shm)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t buf_size = WHEEL_SIZE - page;
+	char  *base;
+
+	/* reserve room for both so nothing else gets mapped in between */
+	if ((base = mmap(NULL, WHEEL_SIZE + buf_size,
+	                 PROT_NONE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+		return err("mmap");
+
+	if (   mmap(base, WHEEL_SIZE,
+	            PROT_READ | PROT_WRITE,
+	            MAP_SHARED | MAP_FIXED, memfd, 0) == MAP_FAILED
+	    || mmap(base + WHEEL_SIZE, buf_size,
+	            PROT_READ | PROT_WRITE,
+	            MAP_SHARED | MAP_FIXED, memfd, page) == MAP_FAILED) {
+		err_t e = err("mmap");
+		munmap(base, WHEEL_SIZE + buf_size);
+		return e;
+	}
+
+	*shm = base;
+	return YIPPIE;
+}
+
+err_t
+close_mirror_shm(char *shm)
+{
+	if (munmap(shm, 2 * WHEEL_SIZE - sysconf(_SC_PAGESIZE)) < 0)
+		return err("munmap");
+	else
+		return YIPPIE;
+}
+
 void
 write_buf(char *buf, size_t bufsize)
 {
@@ -128,6 +254,21 @@ test_buf(const char *buf, size_t bufsize)
 	return memcmp(buf, MAGIC, min(sizeof(MAGIC), bufsize)) == 0;
 }
 
+/* blocks until an eventfd from one of the efd add-ons polls for `events`,
+ * POLLIN for readable or POLLOUT for writable, for the modes that wait on
+ * them without libuv */
+err_t
+wait_fd(int fd, short events)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+
+	while (poll(&pfd, 1, -1) < 0)
+		if (errno != EINTR)
+			return err("poll");
+
+	return YIPPIE;
+}
+
 #ifdef WITH_LIBUV
 
 void
@@ -231,7 +372,7 @@ do_uv_read(uv_poll_t *handle, int status, int events)
 		return;
 
 	if (!test_buf(buf, bufsize))
-		eprintln("% 6i %x failed cmp", r->loops, offset);
+		eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", r->loops, offset);
 
 	whl_efd_return_slice(r->whl_efd, offset);
 
@@ -300,6 +441,146 @@ run_spin_sender(whl_t *whl, size_t *total)
 	}
 }
 
+void
+run_batch_sender(whl_t *whl, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	whl_offset_t  offsets[BATCH_MAX];
+	char         *bufs[BATCH_MAX];
+	size_t        bufsizes[BATCH_MAX];
+	size_t        n = 0;
+	size_t        made;
+
+	while (loops || n) {
+		/* top up the sizes of the messages we have yet to send */
+		for (; loops && n < BATCH_MAX; loops--)
+			bufsizes[n++] = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* spin */
+		while (!(made = whl_make_slices(whl, offsets, bufs, bufsizes, n)));
+
+		for (size_t i = 0; i < made; i++) {
+			write_buf(bufs[i], bufsizes[i]);
+			*total += bufsizes[i];
+		}
+
+		whl_share_slices(whl, offsets, made);
+
+		n -= made;
+		memmove(bufsizes, bufsizes + made, n * sizeof(bufsizes[0]));
+	}
+}
+
+void
+run_pack_sender(whl_t *whl, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	whl_pack_t    pack;
+	char         *buf;
+	size_t        bufsize;
+
+	whl_pack_init(&pack, whl, PACK_FRAME_SIZE);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* spin */
+		while (whl_pack_record(&pack, &buf, bufsize) != 0);
+
+		write_buf(buf, bufsize);
+
+		*total += bufsize;
+	}
+
+	whl_pack_flush(&pack);
+}
+
+typedef struct {
+	char  *buf;
+	size_t size;
+} fill_job_t;
+
+typedef struct {
+	whl_fill_t *fill;
+	/* written by the maker, the number of jobs there are */
+	_Atomic u64 *made;
+	/* the next job for a worker to take */
+	_Atomic u64 *next;
+	/* by ticket, like `whl_fill_t` offsets */
+	fill_job_t  *jobs;
+} fill_worker_t;
+
+void *
+run_fill_worker(void *arg)
+{
+	fill_worker_t *worker = arg;
+	u64            ticket;
+
+	while ((ticket = atomic_fetch_add(worker->next, 1)) < NLOOPS) {
+		/* there's more workers than there's usually work, so give the
+		 * maker the cpu while waiting */
+		while (atomic_load_explicit(worker->made, memory_order_acquire) <= ticket)
+			sched_yield();
+
+		write_buf(worker->jobs[ticket % WHL_FILL_PENDING].buf,
+		          worker->jobs[ticket % WHL_FILL_PENDING].size);
+
+		whl_fill_done(worker->fill, ticket);
+	}
+
+	return NULL;
+}
+
+void
+run_fill_sender(whl_t *whl, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	whl_fill_t    fill;
+	_Atomic u64   made = 0;
+	_Atomic u64   next = 0;
+	u64           ticket;
+	char         *buf;
+	size_t        bufsize;
+	pthread_t     threads[FILL_WORKERS];
+	fill_worker_t worker;
+	fill_job_t    jobs[WHL_FILL_PENDING];
+
+	whl_fill_init(&fill, whl);
+
+	worker = (fill_worker_t) {
+		.fill = &fill,
+		.made = &made,
+		.next = &next,
+		.jobs = jobs,
+	};
+	for (int i = 0; i < FILL_WORKERS; i++)
+		pthread_create(&threads[i], NULL, run_fill_worker, &worker);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* the wheel is full or the workers are behind */
+		while ((ticket = whl_fill_make_slice(&fill, (byte **)&buf, bufsize)) == WHL_FILL_INVALID)
+			sched_yield();
+
+		jobs[ticket % WHL_FILL_PENDING].buf = buf;
+		jobs[ticket % WHL_FILL_PENDING].size = bufsize;
+		atomic_store_explicit(&made, ticket + 1, memory_order_release);
+
+		*total += bufsize;
+	}
+
+	/* spin until the workers are done with the last of them */
+	while (fill.shared < fill.made)
+		whl_fill_share(&fill);
+
+	for (int i = 0; i < FILL_WORKERS; i++)
+		pthread_join(threads[i], NULL);
+}
+
 err_t
 _main_sender_libuv(int sockfd, size_t *total)
 {
@@ -321,7 +602,7 @@ _main_sender_libuv(int sockfd, size_t *total)
 
 	/* shm is open */
 
-	if (   whl_atomic_init(whl, WHEEL_SIZE) < 0
+	if (   whl_atomic_init_aligned(whl, WHEEL_SIZE, slice_align) < 0
 	    || whl_efd_init(&whl_efd, whl) < 0) {
 		e = err("whl_efd_init");
 		close_shm((char *)whl);
@@ -366,7 +647,8 @@ _main_sender_libuv(int sockfd, size_t *total)
 }
 
 err_t
-_main_sender_spin(int sockfd, size_t *total)
+_main_sender_spin(int sockfd, size_t *total,
+                  void (*run_sender)(whl_t *, size_t *))
 {
 	err_t e = YIPPIE;
 	int   memfd;
@@ -384,7 +666,7 @@ _main_sender_spin(int sockfd, size_t *total)
 
 	/* shm is open */
 
-	if (   (whl_init(whl, WHEEL_SIZE) < 0 && iserr(e = err("whl_init")))
+	if (   (whl_init_aligned(whl, WHEEL_SIZE, slice_align) < 0 && iserr(e = err("whl_init_aligned")))
 	    || (send_fd(sockfd, memfd) < 0 && iserr(e = err("send_fd")))) {
 		close_shm((char *)whl);
 		close(memfd);
@@ -395,7 +677,7 @@ _main_sender_spin(int sockfd, size_t *total)
 
 	eprintln("tx whl_t %p", whl);
 
-	run_spin_sender(whl, total);
+	run_sender(whl, total);
 
 	close_shm((char *)whl);
 
@@ -403,128 +685,2249 @@ _main_sender_spin(int sockfd, size_t *total)
 }
 
 err_t
-_main_sender_seqpacket(int sockfd, size_t *total)
+_main_sender_mirror(int sockfd, size_t *total)
 {
-	xorshiftr128plus_t rng = rng_init;
-	char     buf[SEND_SIZE_MAX] = { MAGIC };
-	uint32_t loops = NLOOPS;
+	err_t e = YIPPIE;
+	int   memfd;
+	whl_t *whl;
 
-	eprintln("tx seqpacket %i", sockfd);
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
 
-	while (loops--) {
-		size_t bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+	/* memfd is open */
 
-		if (send(sockfd, buf, bufsize, 0) < 0)
-			return err("send");
+	if (iserr(e = open_mirror_shm(memfd, (char **)&whl))) {
+		close(memfd);
+		return e;
+	}
 
-		*total += bufsize;
+	/* shm is open */
+
+	if (   (whl_init_mirrored(whl, WHEEL_SIZE, slice_align) < 0 && iserr(e = err("whl_init_mirrored")))
+	    || (send_fd(sockfd, memfd) < 0 && iserr(e = err("send_fd")))) {
+		close_mirror_shm((char *)whl);
+		close(memfd);
+		return e;
 	}
 
-	return YIPPIE;
-}
+	close(memfd);
 
-err_t
-main_sender(int sockfd, tport_t tport)
-{
-	err_t  e;
-	size_t total = 0;
+	eprintln("tx mirrored whl_t %p", whl);
 
-	if (tport == TPORT_LIBUV)
-		e = _main_sender_libuv(sockfd, &total);
-	else if (tport == TPORT_SPIN)
-		e = _main_sender_spin(sockfd, &total);
-	else if (tport == TPORT_SEQPACKET)
-		e = _main_sender_seqpacket(sockfd, &total);
-	else
-		return thiserr(EINVAL, "unexpected transport");
+	run_spin_sender(whl, total);
 
-	eprintln("tx done %.3fmb", (float)total / 1024. / 1024.);
+	close_mirror_shm((char *)whl);
 
 	return e;
 }
 
-void
-run_spin_receiver(whl_t *whl, size_t *total)
+err_t
+_main_sender_chain(int sockfd, size_t *total)
 {
-	uint32_t      loops = NLOOPS;
-	whl_offset_t  offset;
-	char         *buf;
-	size_t        bufsize;
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t          loops = NLOOPS;
+	whl_chain_t       chain;
+	whl_chain_stats_t stats;
+	whl_offset_t      offset;
+	char             *buf;
+	size_t            bufsize;
+
+	if (whl_chain_producer_init(&chain, sockfd, CHAIN_SEG_SIZE, CHAIN_SEG_SIZE,
+	                            WHEEL_SIZE, slice_align) < 0)
+		return err("whl_chain_producer_init");
+
+	eprintln("tx chain %p", chain.primary);
 
 	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
 		/* spin */
-		while ((offset = whl_next_shared_slice(whl, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+		while ((offset = whl_chain_make_slice(&chain, &buf, bufsize)) == WHL_INVALID_OFFSET);
 
-		if (!test_buf(buf, bufsize))
-			eprintln("% 6i %x failed cmp", loops, offset);
+		write_buf(buf, bufsize);
 
-		whl_return_slice(whl, offset);
+		whl_chain_share_slice(&chain, offset);
 
 		*total += bufsize;
 	}
+
+	stats = whl_chain_stats(&chain);
+	eprintln("tx chain overflows %lu rejoins %lu capped %lu peak %.0fkb",
+	         stats.overflows, stats.rejoins, stats.capped,
+	         (double)stats.peak_size / 1024.);
+
+	whl_chain_close(&chain);
+
+	return YIPPIE;
 }
 
 err_t
-_main_receiver_libuv(int sockfd, size_t *total)
+_main_sender_spill(int sockfd, size_t *total)
 {
-#ifdef WITH_LIBUV
-	union { int a[3]; struct { int mem, read, write; }; } fds;
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t          loops = NLOOPS;
+	err_t             e = YIPPIE;
+	int               memfd;
+	int               spillfd;
+	whl_t            *whl;
+	whl_spill_t       spill;
+	whl_spill_stats_t stats;
+	whl_offset_t      offset;
+	char             *buf;
+	size_t            bufsize;
 
-	err_t         e = YIPPIE;
-	whl_atomic_t *whl;
-	whl_efd_t     whl_efd;
-	size_t        fds_len = nelements(fds.a);
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
 
-	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
-	    || fds_len != nelements(fds.a))
-		return err("recv_fds");
+	if ((spillfd = open("/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600)) < 0) {
+		e = err("open spill file");
+		close(memfd);
+		return e;
+	}
 
-	if (iserr(e = open_shm(fds.mem, (char **)&whl))) {
-		close(fds.mem);
+	/* memfd and spillfd are open */
+
+	if (iserr(e = open_shm(memfd, (char **)&whl))) {
+		close(spillfd);
+		close(memfd);
 		return e;
 	}
 
-	eprintln("rx whl_atomic_t %p", whl);
+	/* shm is open */
 
-	whl_efd_init_from_eventfds(&whl_efd, whl, fds.read, fds.write);
+	int fds[] = { memfd, spillfd };
+	if (   (whl_init_aligned(whl, WHEEL_SIZE, slice_align) < 0 && iserr(e = err("whl_init_aligned")))
+	    || (whl_spill_init(&spill, whl, spillfd) < 0 && iserr(e = err("whl_spill_init")))
+	    || (send_fds(sockfd, fds, nelements(fds)) < 0 && iserr(e = err("send_fds")))) {
+		close_shm((char *)whl);
+		close(spillfd);
+		close(memfd);
+		return e;
+	}
 
-	receiver_uv_t r = {
-		.whl = whl,
-		.whl_efd = &whl_efd,
-		.sockfd = sockfd,
-		.total = total,
-		.loops = NLOOPS,
-	};
+	close(memfd);
 
-	e = run_uv_receiver(&r);
+	eprintln("tx spilling whl_t %p", whl);
 
-	whl_efd_close(&whl_efd);
-	close(fds.mem);
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
 
-	return YIPPIE;
-#else
-	return err("libuv not compiled in");
-#endif
+		/* spin, only if spilling can't get memory */
+		while ((offset = whl_spill_make_slice(&spill, &buf, bufsize)) == WHL_INVALID_OFFSET);
+
+		write_buf(buf, bufsize);
+
+		if (whl_spill_share_slice(&spill, offset) != 0) {
+			e = err("whl_spill_share_slice");
+			break;
+		}
+
+		*total += bufsize;
+	}
+
+	/* spin until the last spilled messages are marked */
+	while (!iserr(e) && whl_spill_flush(&spill) != 0);
+
+	stats = whl_spill_stats(&spill);
+	eprintln("tx spilled %lu msgs %.3fmb in %lu ranges",
+	         stats.spilled, (double)stats.spilled_bytes / 1024. / 1024.,
+	         stats.markers);
+
+	whl_spill_close(&spill);
+	close(spillfd);
+	close_shm((char *)whl);
+
+	return e;
 }
 
 err_t
-_main_receiver_spin(int sockfd, size_t *total)
+_main_sender_lanes(int sockfd, size_t *total)
 {
-	err_t   e = YIPPIE;
-	int     memfd;
-	whl_t  *whl;
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_lanes_t  *lanes;
+	whl_lanes_efd_t efd;
+	size_t        sizes[] = { LANES_URGENT_SIZE,
+	                          WHEEL_SIZE - WHL_LANES_HEADER_SIZE - LANES_URGENT_SIZE };
+	size_t        lane;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
 
-	if (recv_fd(sockfd, &memfd) < 0)
-		return err("recv_fd");
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
 
-	if (iserr(e = open_shm(memfd, (char **)&whl))) {
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&lanes))) {
 		close(memfd);
 		return e;
 	}
 
-	eprintln("rx whl_t %p", whl);
+	/* shm is open */
 
-	run_spin_receiver(whl, total);
+	if (   (whl_lanes_init(lanes, WHEEL_SIZE, sizes, nelements(sizes)) < 0 && iserr(e = err("whl_lanes_init")))
+	    || (whl_lanes_efd_init(&efd, lanes) < 0 && iserr(e = err("whl_lanes_efd_init")))) {
+		close_shm((char *)lanes);
+		close(memfd);
+		return e;
+	}
+
+	/* efd is open */
+
+	int fds[] = { memfd, -1, -1 };
+	whl_lanes_efd_fds(&efd, &fds[1], &fds[2]);
+	if (send_fds(sockfd, fds, nelements(fds)) < 0) {
+		e = err("send_fds");
+		whl_lanes_efd_close(&efd);
+		close_shm((char *)lanes);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_lanes_t %p", lanes);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+		lane = loops % LANES_URGENT_EVERY == 0 ? 0 : 1;
+
+		/* writable again after a return in either lane, so this might
+		 * wake up with our lane still full */
+		while ((offset = whl_lanes_efd_make_slice(&efd, lane, &buf, bufsize)) == WHL_INVALID_OFFSET)
+			if (iserr(e = wait_fd(efd.writable, POLLOUT)))
+				goto done;
+
+		write_buf(buf, bufsize);
+
+		whl_lanes_efd_share_slice(&efd, lane, offset);
+
+		*total += bufsize;
+	}
+
+done:
+	whl_lanes_efd_close(&efd);
+	close_shm((char *)lanes);
+
+	return e;
+}
+
+err_t
+_main_sender_ring(int sockfd, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_ring_t   *ring;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&ring))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_ring_init(ring, WHEEL_SIZE, RING_SLOTS) < 0 && iserr(e = err("whl_ring_init")))
+	    || (send_fd(sockfd, memfd) < 0 && iserr(e = err("send_fd")))) {
+		close_shm((char *)ring);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_ring_t %p", ring);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* spin */
+		while ((offset = whl_ring_make_slice(ring, &buf, bufsize)) == WHL_INVALID_OFFSET);
+
+		write_buf(buf, bufsize);
+
+		whl_ring_share_slice(ring, offset);
+
+		*total += bufsize;
+	}
+
+	close_shm((char *)ring);
+
+	return e;
+}
+
+err_t
+_main_sender_slots(int sockfd, size_t *total)
+{
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_slots_t  *slots;
+	whl_slots_efd_t efd;
+	whl_offset_t  offset;
+	char         *buf;
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&slots))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_slots_init(slots, WHEEL_SIZE, SLOTS_SIZE, whl_slots_count(WHEEL_SIZE, SLOTS_SIZE)) < 0 && iserr(e = err("whl_slots_init")))
+	    || (whl_slots_efd_init(&efd, slots) < 0 && iserr(e = err("whl_slots_efd_init")))) {
+		close_shm((char *)slots);
+		close(memfd);
+		return e;
+	}
+
+	/* efd is open */
+
+	int fds[] = { memfd, -1, -1 };
+	whl_slots_efd_fds(&efd, &fds[1], &fds[2]);
+	if (send_fds(sockfd, fds, nelements(fds)) < 0) {
+		e = err("send_fds");
+		whl_slots_efd_close(&efd);
+		close_shm((char *)slots);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_slots_t %p", slots);
+
+	while (loops--) {
+		while ((offset = whl_slots_efd_make_slot(&efd, &buf)) == WHL_INVALID_OFFSET)
+			if (iserr(e = wait_fd(efd.writable, POLLOUT)))
+				goto done;
+
+		write_buf(buf, SLOTS_SIZE);
+
+		whl_slots_efd_share_slot(&efd, offset);
+
+		*total += SLOTS_SIZE;
+	}
+
+done:
+	whl_slots_efd_close(&efd);
+	close_shm((char *)slots);
+
+	return e;
+}
+
+typedef struct {
+	whl_mpsc_efd_t *efd;
+	uint32_t        loops;
+	size_t          total;
+	err_t           e;
+} mpsc_producer_t;
+
+void *
+run_mpsc_producer(void *arg)
+{
+	xorshiftr128plus_t rng = rng_init;
+	mpsc_producer_t   *producer = arg;
+	whl_offset_t       offset;
+	char              *buf;
+	size_t             bufsize;
+
+	while (producer->loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* the ring is full, every waiting producer wakes up when the
+		 * receiver returns something */
+		while ((offset = whl_mpsc_efd_make_slice(producer->efd, &buf, bufsize)) == WHL_INVALID_OFFSET)
+			if (iserr(producer->e = wait_fd(producer->efd->writable, POLLOUT)))
+				return NULL;
+
+		write_buf(buf, bufsize);
+
+		whl_mpsc_efd_share_slice(producer->efd, offset);
+
+		producer->total += bufsize;
+	}
+
+	return NULL;
+}
+
+err_t
+_main_sender_mpsc(int sockfd, size_t *total)
+{
+	uint32_t        loops = NLOOPS;
+	uint32_t        rounds = 0;
+	err_t           e = YIPPIE;
+	int             memfd;
+	whl_mpsc_t     *mpsc;
+	whl_mpsc_efd_t  efd;
+	pthread_t       threads[MPSC_PRODUCERS_MAX];
+	mpsc_producer_t producers[MPSC_PRODUCERS_MAX];
+	timespec_t      before, after;
+	double          elapsed;
+
+	for (int n = 1; n <= MPSC_PRODUCERS_MAX; n *= 2)
+		rounds++;
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&mpsc))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_mpsc_init(mpsc, WHEEL_SIZE) < 0 && iserr(e = err("whl_mpsc_init")))
+	    || (whl_mpsc_efd_init(&efd, mpsc) < 0 && iserr(e = err("whl_mpsc_efd_init")))) {
+		close_shm((char *)mpsc);
+		close(memfd);
+		return e;
+	}
+
+	/* efd is open */
+
+	int fds[] = { memfd, -1, -1 };
+	whl_mpsc_efd_fds(&efd, &fds[1], &fds[2]);
+	if (send_fds(sockfd, fds, nelements(fds)) < 0) {
+		e = err("send_fds");
+		whl_mpsc_efd_close(&efd);
+		close_shm((char *)mpsc);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_mpsc_t %p", mpsc);
+
+	for (int n = 1; n <= MPSC_PRODUCERS_MAX; n *= 2) {
+		/* the last round sends what's left over */
+		uint32_t round = n * 2 > MPSC_PRODUCERS_MAX ? loops : NLOOPS / rounds;
+
+		loops -= round;
+
+		clock_gettime(CLOCK_MONOTONIC, &before);
+
+		for (int i = 0; i < n; i++) {
+			producers[i] = (mpsc_producer_t) {
+				.efd = &efd,
+				.loops = round / n + (i == 0 ? round % n : 0),
+			};
+			pthread_create(&threads[i], NULL, run_mpsc_producer, &producers[i]);
+		}
+
+		for (int i = 0; i < n; i++) {
+			pthread_join(threads[i], NULL);
+			*total += producers[i].total;
+			if (iserr(producers[i].e))
+				e = producers[i].e;
+		}
+
+		if (iserr(e))
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &after);
+
+		elapsed = (double)(after.tv_sec - before.tv_sec)
+		        + (double)(after.tv_nsec - before.tv_nsec) / (double)NANOS_PER_SEC;
+		eprintln("tx mpsc %2i producers %.0f msgs/s", n, round / elapsed);
+	}
+
+	whl_mpsc_efd_close(&efd);
+	close_shm((char *)mpsc);
+
+	return e;
+}
+
+err_t
+_main_sender_bcast(int sockfd, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_bcast_t  *bcast;
+	whl_bcast_efd_t efd;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+	/* the memfd, the writable eventfd, then each consumer's readable one */
+	int           fds[2 + BCAST_CONSUMERS];
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&bcast))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_bcast_init(bcast, WHEEL_SIZE, BCAST_CONSUMERS) < 0 && iserr(e = err("whl_bcast_init")))
+	    || (whl_bcast_efd_init(&efd, bcast) < 0 && iserr(e = err("whl_bcast_efd_init")))) {
+		close_shm((char *)bcast);
+		close(memfd);
+		return e;
+	}
+
+	/* efd is open */
+
+	fds[0] = memfd;
+	for (size_t i = 0; i < BCAST_CONSUMERS; i++)
+		whl_bcast_efd_fds(&efd, i, &fds[2 + i], &fds[1]);
+	if (send_fds(sockfd, fds, nelements(fds)) < 0) {
+		e = err("send_fds");
+		whl_bcast_efd_close(&efd);
+		close_shm((char *)bcast);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_bcast_t %p", bcast);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* writable again once the slowest consumer returns something */
+		while ((offset = whl_bcast_efd_make_slice(&efd, &buf, bufsize)) == WHL_INVALID_OFFSET)
+			if (iserr(e = wait_fd(efd.writable, POLLOUT)))
+				goto done;
+
+		write_buf(buf, bufsize);
+
+		whl_bcast_efd_share_slice(&efd, offset);
+
+		*total += bufsize;
+	}
+
+done:
+	whl_bcast_efd_close(&efd);
+	close_shm((char *)bcast);
+
+	return e;
+}
+
+typedef struct {
+	whl_mpmc_efd_t *efd;
+	/* or, for shards */
+	whl_t          *whl;
+	uint32_t        loops;
+	size_t          total;
+	err_t           e;
+} mpmc_producer_t;
+
+void *
+run_mpmc_producer(void *arg)
+{
+	xorshiftr128plus_t rng = rng_init;
+	mpmc_producer_t   *producer = arg;
+	whl_offset_t       offset;
+	char              *buf;
+	size_t             bufsize;
+
+	while (producer->loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* one waiting producer wakes each time a consumer gives back
+		 * room */
+		while ((offset = whl_mpmc_make_slice(producer->efd->mpmc, &buf, bufsize)) == WHL_INVALID_OFFSET)
+			if (   whl_mpmc_efd_wait_writable(producer->efd, -1) < 0
+			    && iserr(producer->e = err("whl_mpmc_efd_wait_writable")))
+				return NULL;
+
+		write_buf(buf, bufsize);
+
+		whl_mpmc_efd_share_slice(producer->efd, offset);
+
+		producer->total += bufsize;
+	}
+
+	return NULL;
+}
+
+void *
+run_shard_producer(void *arg)
+{
+	xorshiftr128plus_t rng = rng_init;
+	mpmc_producer_t   *producer = arg;
+	whl_offset_t       offset;
+	char              *buf;
+	size_t             bufsize;
+
+	while (producer->loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		while ((offset = whl_make_slice(producer->whl, &buf, bufsize)) == WHL_INVALID_OFFSET)
+			sched_yield();
+
+		write_buf(buf, bufsize);
+
+		whl_share_slice(producer->whl, offset);
+
+		producer->total += bufsize;
+	}
+
+	return NULL;
+}
+
+/* runs MPMC_THREADS producers splitting NLOOPS messages between them */
+err_t
+run_mpmc_producers(mpmc_producer_t *producers, void *(*run)(void *),
+                   const char *name, size_t *total)
+{
+	err_t      e = YIPPIE;
+	pthread_t  threads[MPMC_THREADS];
+	timespec_t before, after;
+	double     elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &before);
+
+	for (int i = 0; i < MPMC_THREADS; i++) {
+		producers[i].loops = NLOOPS / MPMC_THREADS
+		                   + (i == 0 ? NLOOPS % MPMC_THREADS : 0);
+		pthread_create(&threads[i], NULL, run, &producers[i]);
+	}
+
+	for (int i = 0; i < MPMC_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		*total += producers[i].total;
+		if (iserr(producers[i].e))
+			e = producers[i].e;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &after);
+
+	elapsed = (double)(after.tv_sec - before.tv_sec)
+	        + (double)(after.tv_nsec - before.tv_nsec) / (double)NANOS_PER_SEC;
+	eprintln("tx %s %i producers %.0f msgs/s", name, MPMC_THREADS,
+	         NLOOPS / elapsed);
+
+	return e;
+}
+
+err_t
+_main_sender_mpmc(int sockfd, size_t *total)
+{
+	err_t           e = YIPPIE;
+	int             memfd;
+	whl_mpmc_t     *mpmc;
+	whl_mpmc_efd_t  efd;
+	mpmc_producer_t producers[MPMC_THREADS];
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&mpmc))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_mpmc_init(mpmc, WHEEL_SIZE) < 0 && iserr(e = err("whl_mpmc_init")))
+	    || (whl_mpmc_efd_init(&efd, mpmc) < 0 && iserr(e = err("whl_mpmc_efd_init")))) {
+		close_shm((char *)mpmc);
+		close(memfd);
+		return e;
+	}
+
+	/* efd is open */
+
+	int fds[] = { memfd, -1, -1 };
+	whl_mpmc_efd_fds(&efd, &fds[1], &fds[2]);
+	if (send_fds(sockfd, fds, nelements(fds)) < 0) {
+		e = err("send_fds");
+		whl_mpmc_efd_close(&efd);
+		close_shm((char *)mpmc);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_mpmc_t %p", mpmc);
+
+	for (int i = 0; i < MPMC_THREADS; i++)
+		producers[i] = (mpmc_producer_t) { .efd = &efd };
+
+	e = run_mpmc_producers(producers, run_mpmc_producer, "mpmc", total);
+
+	whl_mpmc_efd_close(&efd);
+	close_shm((char *)mpmc);
+
+	return e;
+}
+
+err_t
+_main_sender_shards(int sockfd, size_t *total)
+{
+	err_t           e = YIPPIE;
+	int             memfd;
+	char           *shm;
+	mpmc_producer_t producers[MPMC_THREADS];
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, &shm))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	for (int i = 0; i < MPMC_THREADS; i++) {
+		producers[i] = (mpmc_producer_t) {
+			.whl = (whl_t *)(shm + i * (WHEEL_SIZE / MPMC_THREADS)),
+		};
+		if (whl_init_aligned(producers[i].whl, WHEEL_SIZE / MPMC_THREADS, slice_align) < 0) {
+			e = err("whl_init_aligned");
+			break;
+		}
+	}
+
+	if (   iserr(e)
+	    || (send_fd(sockfd, memfd) < 0 && iserr(e = err("send_fd")))) {
+		close_shm(shm);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx %i whl_t shards %p", MPMC_THREADS, shm);
+
+	e = run_mpmc_producers(producers, run_shard_producer, "shards", total);
+
+	close_shm(shm);
+
+	return e;
+}
+
+typedef struct {
+	whl_percpu_t *percpu;
+	uint32_t      loops;
+	size_t        total;
+} percpu_producer_t;
+
+void *
+run_percpu_producer(void *arg)
+{
+	xorshiftr128plus_t rng = rng_init;
+	percpu_producer_t *producer = arg;
+	whl_offset_t       offset;
+	uint32_t           wheel;
+	char              *buf;
+	size_t             bufsize;
+
+	while (producer->loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		while ((offset = whl_percpu_make_slice(producer->percpu, &wheel, &buf, bufsize)) == WHL_INVALID_OFFSET)
+			sched_yield();
+
+		write_buf(buf, bufsize);
+
+		whl_percpu_share_slice(producer->percpu, wheel, offset);
+
+		producer->total += bufsize;
+	}
+
+	return NULL;
+}
+
+err_t
+_main_sender_percpu(int sockfd, size_t *total)
+{
+	err_t             e = YIPPIE;
+	int               memfd;
+	whl_percpu_t     *percpu;
+	long              cpus = sysconf(_SC_NPROCESSORS_CONF);
+	pthread_t         threads[PERCPU_PRODUCERS];
+	percpu_producer_t producers[PERCPU_PRODUCERS];
+	timespec_t        before, after;
+	double            elapsed;
+
+	if (cpus < 1)
+		cpus = 1;
+	else if (cpus > WHL_PERCPU_MAX)
+		cpus = WHL_PERCPU_MAX;
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&percpu))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_percpu_init_aligned(percpu, WHEEL_SIZE, cpus, slice_align) < 0 && iserr(e = err("whl_percpu_init_aligned")))
+	    || (send_fd(sockfd, memfd) < 0 && iserr(e = err("send_fd")))) {
+		close_shm((char *)percpu);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_percpu_t %p %li wheels", percpu, cpus);
+
+	clock_gettime(CLOCK_MONOTONIC, &before);
+
+	for (int i = 0; i < PERCPU_PRODUCERS; i++) {
+		producers[i] = (percpu_producer_t) {
+			.percpu = percpu,
+			.loops = NLOOPS / PERCPU_PRODUCERS
+			       + (i == 0 ? NLOOPS % PERCPU_PRODUCERS : 0),
+		};
+		pthread_create(&threads[i], NULL, run_percpu_producer, &producers[i]);
+	}
+
+	for (int i = 0; i < PERCPU_PRODUCERS; i++) {
+		pthread_join(threads[i], NULL);
+		*total += producers[i].total;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &after);
+
+	elapsed = (double)(after.tv_sec - before.tv_sec)
+	        + (double)(after.tv_nsec - before.tv_nsec) / (double)NANOS_PER_SEC;
+	eprintln("tx percpu %i producers %.0f msgs/s", PERCPU_PRODUCERS,
+	         NLOOPS / elapsed);
+
+	close_shm((char *)percpu);
+
+	return e;
+}
+
+err_t
+_main_sender_lossy(int sockfd, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_lossy_t  *lossy;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&lossy))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_lossy_init(lossy, WHEEL_SIZE) < 0 && iserr(e = err("whl_lossy_init")))
+	    || (send_fd(sockfd, memfd) < 0 && iserr(e = err("send_fd")))) {
+		close_shm((char *)lossy);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_lossy_t %p", lossy);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* never waits */
+		offset = whl_lossy_make_slice(lossy, &buf, bufsize);
+
+		write_buf(buf, bufsize);
+
+		whl_lossy_share_slice(lossy, offset);
+
+		*total += bufsize;
+	}
+
+	close_shm((char *)lossy);
+
+	return e;
+}
+
+err_t
+_main_sender_latest(int sockfd, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_latest_t *latest;
+	whl_latest_efd_t efd;
+	char         *buf;
+	size_t        bufsize;
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&latest))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	/* too small for a line in front of each buffer, just big enough, and a
+	 * size too big to round up, before the real one */
+	if (   (whl_latest_init(latest, WHL_LATEST_HEADER_SIZE + WHL_CACHE_LINE, 1) == 0 && iserr(e = thiserr(EINVAL, "whl_latest_init too small")))
+	    || (whl_latest_init(latest, WHL_LATEST_HEADER_SIZE + 4 * WHL_CACHE_LINE, 1) < 0 && iserr(e = err("whl_latest_init just big enough")))
+	    || (whl_latest_init(latest, WHEEL_SIZE, SIZE_MAX) == 0 && iserr(e = thiserr(EINVAL, "whl_latest_init too big")))
+	    || (whl_latest_init(latest, WHEEL_SIZE, SEND_SIZE_MAX) < 0 && iserr(e = err("whl_latest_init")))
+	    || (whl_latest_efd_init(&efd, latest) < 0 && iserr(e = err("whl_latest_efd_init")))) {
+		close_shm((char *)latest);
+		close(memfd);
+		return e;
+	}
+
+	/* efd is open */
+
+	int fds[] = { memfd, efd.readable };
+	if (send_fds(sockfd, fds, nelements(fds)) < 0) {
+		e = err("send_fds");
+		whl_latest_efd_close(&efd);
+		close_shm((char *)latest);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_latest_t %p", latest);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* never waits */
+		whl_latest_make_value(latest, (byte **)&buf);
+
+		write_buf(buf, bufsize);
+
+		whl_latest_efd_share_value(&efd, bufsize);
+
+		*total += bufsize;
+	}
+
+	whl_latest_efd_close(&efd);
+	close_shm((char *)latest);
+
+	return e;
+}
+
+void
+run_split_sender(whl_split_t *split, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t       loops = NLOOPS;
+	whl_producer_t producer;
+	whl_offset_t   offset;
+	char          *buf;
+	size_t         bufsize;
+
+	whl_producer_init(&producer, split);
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		/* spin */
+		while ((offset = whl_producer_make_slice(&producer, &buf, bufsize)) == WHL_INVALID_OFFSET);
+
+		write_buf(buf, bufsize);
+
+		whl_producer_share_slice(&producer, offset);
+
+		*total += bufsize;
+	}
+}
+
+err_t
+_main_sender_split(int sockfd, size_t *total)
+{
+	err_t        e = YIPPIE;
+	int          memfd;
+	whl_split_t *split;
+
+	if (iserr(e = open_memfd(&memfd)))
+		return e;
+
+	/* memfd is open */
+
+	if (iserr(e = open_shm(memfd, (char **)&split))) {
+		close(memfd);
+		return e;
+	}
+
+	/* shm is open */
+
+	if (   (whl_split_init_aligned(split, WHEEL_SIZE, slice_align) < 0 && iserr(e = err("whl_split_init_aligned")))
+	    || (send_fd(sockfd, memfd) < 0 && iserr(e = err("send_fd")))) {
+		close_shm((char *)split);
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("tx whl_split_t %p", split);
+
+	run_split_sender(split, total);
+
+	close_shm((char *)split);
+
+	return e;
+}
+
+err_t
+_main_sender_seqpacket(int sockfd, size_t *total)
+{
+	xorshiftr128plus_t rng = rng_init;
+	char     buf[SEND_SIZE_MAX] = { MAGIC };
+	uint32_t loops = NLOOPS;
+
+	eprintln("tx seqpacket %i", sockfd);
+
+	while (loops--) {
+		size_t bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+
+		if (send(sockfd, buf, bufsize, 0) < 0)
+			return err("send");
+
+		*total += bufsize;
+	}
+
+	return YIPPIE;
+}
+
+/* the fraction of the wheel that the messages' bytes take up, the rest is
+ * headers and alignment padding */
+double
+density(size_t align)
+{
+	xorshiftr128plus_t rng = rng_init;
+	uint32_t      loops = NLOOPS;
+	uint64_t      used = 0;
+	uint64_t      bytes = 0;
+	size_t        bufsize;
+
+	while (loops--) {
+		bufsize = xorshiftr128plus(&rng) % SEND_SIZE_MAX;
+		bytes += bufsize;
+		used += (sizeof(whl_slice_t) + bufsize + align - 1) & ~(align - 1);
+	}
+
+	return (double)bytes / (double)used;
+}
+
+err_t
+main_sender(int sockfd, tport_t tport)
+{
+	err_t  e;
+	size_t total = 0;
+
+	if (tport == TPORT_LIBUV)
+		e = _main_sender_libuv(sockfd, &total);
+	else if (tport == TPORT_SPIN)
+		e = _main_sender_spin(sockfd, &total, run_spin_sender);
+	else if (tport == TPORT_SEQPACKET)
+		e = _main_sender_seqpacket(sockfd, &total);
+	else if (tport == TPORT_SPLIT)
+		e = _main_sender_split(sockfd, &total);
+	else if (tport == TPORT_BATCH)
+		e = _main_sender_spin(sockfd, &total, run_batch_sender);
+	else if (tport == TPORT_MIRROR)
+		e = _main_sender_mirror(sockfd, &total);
+	else if (tport == TPORT_CHAIN)
+		e = _main_sender_chain(sockfd, &total);
+	else if (tport == TPORT_SPILL)
+		e = _main_sender_spill(sockfd, &total);
+	else if (tport == TPORT_LANES)
+		e = _main_sender_lanes(sockfd, &total);
+	else if (tport == TPORT_RING)
+		e = _main_sender_ring(sockfd, &total);
+	else if (tport == TPORT_SLOTS)
+		e = _main_sender_slots(sockfd, &total);
+	else if (tport == TPORT_PACK)
+		e = _main_sender_spin(sockfd, &total, run_pack_sender);
+	else if (tport == TPORT_LOSSY)
+		e = _main_sender_lossy(sockfd, &total);
+	else if (tport == TPORT_LATEST)
+		e = _main_sender_latest(sockfd, &total);
+	else if (tport == TPORT_POOL)
+		e = _main_sender_spin(sockfd, &total, run_spin_sender);
+	else if (tport == TPORT_FILL)
+		e = _main_sender_spin(sockfd, &total, run_fill_sender);
+	else if (tport == TPORT_MPSC)
+		e = _main_sender_mpsc(sockfd, &total);
+	else if (tport == TPORT_BCAST)
+		e = _main_sender_bcast(sockfd, &total);
+	else if (tport == TPORT_TAP)
+		e = _main_sender_split(sockfd, &total);
+	else if (tport == TPORT_MPMC)
+		e = _main_sender_mpmc(sockfd, &total);
+	else if (tport == TPORT_SHARDS)
+		e = _main_sender_shards(sockfd, &total);
+	else if (tport == TPORT_PERCPU)
+		e = _main_sender_percpu(sockfd, &total);
+	else
+		return thiserr(EINVAL, "unexpected transport");
+
+	eprintln("tx done %.3fmb", (float)total / 1024. / 1024.);
+
+	if (   tport != TPORT_SEQPACKET
+	    && tport != TPORT_CHAIN
+	    && tport != TPORT_SPILL
+	    && tport != TPORT_LANES
+	    && tport != TPORT_RING
+	    && tport != TPORT_SLOTS
+	    && tport != TPORT_PACK
+	    && tport != TPORT_LOSSY
+	    && tport != TPORT_LATEST
+	    && tport != TPORT_MPSC
+	    && tport != TPORT_BCAST
+	    && tport != TPORT_MPMC
+	    && tport != TPORT_SHARDS
+	    && tport != TPORT_PERCPU) {
+		double d = density(slice_align);
+		eprintln("tx align %zu density %.1f%% about %.0f messages fit",
+		         slice_align, 100. * d,
+		         d * WHEEL_SIZE * NLOOPS / (total ? total : 1));
+	}
+
+	return e;
+}
+
+void
+run_spin_receiver(whl_t *whl, size_t *total)
+{
+	uint32_t      loops = NLOOPS;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+
+	while (loops--) {
+		/* spin */
+		while ((offset = whl_next_shared_slice(whl, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_return_slice(whl, offset);
+
+		*total += bufsize;
+	}
+}
+
+void
+run_batch_receiver(whl_t *whl, size_t *total)
+{
+	uint32_t      loops = NLOOPS;
+	whl_iter_t    iter;
+	whl_offset_t  offset;
+	whl_offset_t  through;
+	char         *buf;
+	size_t        bufsize;
+
+	while (loops) {
+		/* spin */
+		do {
+			whl_iter_shared_slices(whl, &iter);
+		} while ((offset = whl_iter_next(whl, &iter, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+
+		do {
+			loops--;
+
+			if (!test_buf(buf, bufsize))
+				eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+			*total += bufsize;
+			through = offset;
+		} while ((offset = whl_iter_next(whl, &iter, &buf, &bufsize)) != WHL_INVALID_OFFSET);
+
+		whl_return_through(whl, through);
+	}
+}
+
+void
+run_pack_receiver(whl_t *whl, size_t *total)
+{
+	uint32_t      loops = NLOOPS;
+	whl_unpack_t  unpack;
+	char         *buf;
+	size_t        bufsize;
+
+	whl_unpack_init(&unpack, whl);
+
+	while (loops--) {
+		/* spin */
+		while (whl_unpack_next(&unpack, &buf, &bufsize) != 0);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i failed cmp", loops);
+
+		*total += bufsize;
+	}
+}
+
+typedef struct {
+	whl_pool_t      *pool;
+	pthread_mutex_t *lock;
+	/* messages left to get, under lock */
+	uint32_t        *left;
+	int              slow;
+	size_t           total;
+} pool_worker_t;
+
+void *
+run_pool_worker(void *arg)
+{
+	pool_worker_t *worker = arg;
+	whl_offset_t   offset;
+	char          *buf;
+	size_t         bufsize;
+	uint32_t       n;
+
+	struct timespec pause = { .tv_nsec = POOL_SLOW_NS };
+
+	for (;;) {
+		/* the pool only takes one thread getting slices at a time */
+		pthread_mutex_lock(worker->lock);
+		if ((n = *worker->left) == 0) {
+			pthread_mutex_unlock(worker->lock);
+			break;
+		}
+		*worker->left = n - 1;
+		/* spin */
+		while ((offset = whl_pool_next_shared_slice(worker->pool, (byte **)&buf, &bufsize)) == WHL_INVALID_OFFSET);
+		pthread_mutex_unlock(worker->lock);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", n, offset);
+
+		if (worker->slow && n % POOL_SLOW_EVERY == 0)
+			nanosleep(&pause, NULL);
+
+		whl_pool_return_slice(worker->pool, offset);
+
+		worker->total += bufsize;
+	}
+
+	return NULL;
+}
+
+void
+run_pool_receiver(whl_t *whl, size_t *total)
+{
+	uint32_t         left = NLOOPS;
+	whl_pool_t       pool;
+	whl_pool_stats_t stats;
+	pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+	pthread_t        threads[POOL_WORKERS];
+	pool_worker_t    workers[POOL_WORKERS];
+
+	whl_pool_init(&pool, whl);
+
+	for (int i = 0; i < POOL_WORKERS; i++) {
+		workers[i] = (pool_worker_t) {
+			.pool = &pool,
+			.lock = &lock,
+			.left = &left,
+			.slow = i == 0,
+		};
+		pthread_create(&threads[i], NULL, run_pool_worker, &workers[i]);
+	}
+
+	for (int i = 0; i < POOL_WORKERS; i++) {
+		pthread_join(threads[i], NULL);
+		*total += workers[i].total;
+	}
+
+	stats = whl_pool_stats(&pool);
+	eprintln("rx pool dispatched %lu waited %lu peak waiting %lu",
+	         stats.dispatched, stats.waited, stats.peak_waiting);
+}
+
+err_t
+_main_receiver_libuv(int sockfd, size_t *total)
+{
+#ifdef WITH_LIBUV
+	union { int a[3]; struct { int mem, read, write; }; } fds;
+
+	err_t         e = YIPPIE;
+	whl_atomic_t *whl;
+	whl_efd_t     whl_efd;
+	size_t        fds_len = nelements(fds.a);
+
+	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
+	    || fds_len != nelements(fds.a))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds.mem, (char **)&whl))) {
+		close(fds.mem);
+		return e;
+	}
+
+	eprintln("rx whl_atomic_t %p", whl);
+
+	whl_efd_init_from_eventfds(&whl_efd, whl, fds.read, fds.write);
+
+	receiver_uv_t r = {
+		.whl = whl,
+		.whl_efd = &whl_efd,
+		.sockfd = sockfd,
+		.total = total,
+		.loops = NLOOPS,
+	};
+
+	e = run_uv_receiver(&r);
+
+	whl_efd_close(&whl_efd);
+	close(fds.mem);
+
+	return YIPPIE;
+#else
+	return err("libuv not compiled in");
+#endif
+}
+
+err_t
+_main_receiver_spin(int sockfd, size_t *total,
+                    void (*run_receiver)(whl_t *, size_t *))
+{
+	err_t   e = YIPPIE;
+	int     memfd;
+	whl_t  *whl;
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_shm(memfd, (char **)&whl))) {
+		close(memfd);
+		return e;
+	}
+
+	eprintln("rx whl_t %p", whl);
+
+	run_receiver(whl, total);
+
+	return YIPPIE;
+}
+
+err_t
+_main_receiver_mirror(int sockfd, size_t *total)
+{
+	err_t   e = YIPPIE;
+	int     memfd;
+	whl_t  *whl;
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_mirror_shm(memfd, (char **)&whl))) {
+		close(memfd);
+		return e;
+	}
+
+	eprintln("rx mirrored whl_t %p", whl);
+
+	run_spin_receiver(whl, total);
+
+	return YIPPIE;
+}
+
+err_t
+_main_receiver_chain(int sockfd, size_t *total)
+{
+	uint32_t     loops = NLOOPS;
+	whl_chain_t  chain;
+	whl_offset_t offset;
+	char        *buf;
+	size_t       bufsize;
+
+	if (whl_chain_consumer_init(&chain, sockfd) < 0)
+		return err("whl_chain_consumer_init");
+
+	eprintln("rx chain %p", chain.primary);
+
+	while (loops--) {
+		/* spin */
+		while ((offset = whl_chain_next_shared_slice(&chain, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_chain_return_slice(&chain, offset);
+
+		*total += bufsize;
+	}
+
+	whl_chain_close(&chain);
+
+	return YIPPIE;
+}
+
+err_t
+_main_receiver_spill(int sockfd, size_t *total)
+{
+	union { int a[2]; struct { int mem, spill; }; } fds;
+
+	uint32_t     loops = NLOOPS;
+	err_t        e = YIPPIE;
+	whl_t       *whl;
+	whl_spill_t  spill;
+	whl_offset_t offset;
+	char        *buf;
+	size_t       bufsize;
+	size_t       fds_len = nelements(fds.a);
+	timespec_t   pause = { 0, SPILL_PAUSE_NS };
+
+	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
+	    || fds_len != nelements(fds.a))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds.mem, (char **)&whl))) {
+		close(fds.mem);
+		close(fds.spill);
+		return e;
+	}
+
+	close(fds.mem);
+	whl_spill_init(&spill, whl, fds.spill);
+
+	eprintln("rx spilling whl_t %p", whl);
+
+	while (loops--) {
+		/* like a consumer stopping for a garbage collection */
+		if (loops % SPILL_PAUSE_EVERY == 0)
+			nanosleep(&pause, NULL);
+
+		/* spin */
+		while ((offset = whl_spill_next_shared_slice(&spill, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_spill_return_slice(&spill, offset);
+
+		*total += bufsize;
+	}
+
+	whl_spill_close(&spill);
+	close(fds.spill);
+	close_shm((char *)whl);
+
+	return YIPPIE;
+}
+
+err_t
+_main_receiver_lanes(int sockfd, size_t *total)
+{
+	union { int a[3]; struct { int mem, read, write; }; } fds;
+
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	whl_lanes_t  *lanes;
+	whl_lanes_efd_t efd;
+	uint32_t      counts[2] = { 0 };
+	uint32_t      waits = 0;
+	size_t        lane;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+	size_t        fds_len = nelements(fds.a);
+
+	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
+	    || fds_len != nelements(fds.a))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds.mem, (char **)&lanes))) {
+		close(fds.mem);
+		close(fds.read);
+		close(fds.write);
+		return e;
+	}
+
+	close(fds.mem);
+	whl_lanes_efd_init_from_eventfds(&efd, lanes, fds.read, fds.write);
+
+	eprintln("rx whl_lanes_t %p", lanes);
+
+	while (loops--) {
+		/* one readable eventfd for both lanes */
+		while ((offset = whl_lanes_efd_next_shared_slice(&efd, &lane, &buf, &bufsize)) == WHL_INVALID_OFFSET) {
+			if (iserr(e = wait_fd(efd.readable, POLLIN)))
+				goto done;
+			waits++;
+		}
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_lanes_efd_return_slice(&efd, lane, offset);
+
+		counts[lane]++;
+		*total += bufsize;
+	}
+
+	eprintln("rx lane 0 %u msgs lane 1 %u msgs waited %u times",
+	         counts[0], counts[1], waits);
+
+done:
+	whl_lanes_efd_close(&efd);
+	close_shm((char *)lanes);
+
+	return e;
+}
+
+err_t
+_main_receiver_ring(int sockfd, size_t *total)
+{
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_ring_t   *ring;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_shm(memfd, (char **)&ring))) {
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("rx whl_ring_t %p", ring);
+
+	while (loops--) {
+		/* spin */
+		while ((offset = whl_ring_next_shared_slice(ring, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_ring_return_slice(ring, offset);
+
+		*total += bufsize;
+	}
+
+	close_shm((char *)ring);
+
+	return YIPPIE;
+}
+
+err_t
+_main_receiver_slots(int sockfd, size_t *total)
+{
+	union { int a[3]; struct { int mem, read, write; }; } fds;
+
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	whl_slots_t  *slots;
+	whl_slots_efd_t efd;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        fds_len = nelements(fds.a);
+
+	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
+	    || fds_len != nelements(fds.a))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds.mem, (char **)&slots))) {
+		close(fds.mem);
+		close(fds.read);
+		close(fds.write);
+		return e;
+	}
+
+	close(fds.mem);
+	whl_slots_efd_init_from_eventfds(&efd, slots, fds.read, fds.write);
+
+	eprintln("rx whl_slots_t %p", slots);
+
+	while (loops--) {
+		while ((offset = whl_slots_efd_next_shared_slot(&efd, &buf)) == WHL_INVALID_OFFSET)
+			if (iserr(e = wait_fd(efd.readable, POLLIN)))
+				goto done;
+
+		if (!test_buf(buf, SLOTS_SIZE))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_slots_efd_return_slot(&efd, offset);
+
+		*total += SLOTS_SIZE;
+	}
+
+done:
+	whl_slots_efd_close(&efd);
+	close_shm((char *)slots);
+
+	return e;
+}
+
+err_t
+_main_receiver_mpsc(int sockfd, size_t *total)
+{
+	union { int a[3]; struct { int mem, read, write; }; } fds;
+
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	whl_mpsc_t   *mpsc;
+	whl_mpsc_efd_t efd;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+	size_t        fds_len = nelements(fds.a);
+
+	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
+	    || fds_len != nelements(fds.a))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds.mem, (char **)&mpsc))) {
+		close(fds.mem);
+		close(fds.read);
+		close(fds.write);
+		return e;
+	}
+
+	close(fds.mem);
+	whl_mpsc_efd_init_from_eventfds(&efd, mpsc, fds.read, fds.write);
+
+	eprintln("rx whl_mpsc_t %p", mpsc);
+
+	while (loops--) {
+		while ((offset = whl_mpsc_efd_next_shared_slice(&efd, &buf, &bufsize)) == WHL_INVALID_OFFSET)
+			if (iserr(e = wait_fd(efd.readable, POLLIN)))
+				goto done;
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_mpsc_efd_return_slice(&efd, offset);
+
+		*total += bufsize;
+	}
+
+done:
+	whl_mpsc_efd_close(&efd);
+	close_shm((char *)mpsc);
+
+	return e;
+}
+
+err_t
+_main_receiver_bcast(int sockfd, size_t *total)
+{
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	whl_bcast_t  *bcast;
+	whl_bcast_efd_t efd;
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+	size_t        consumer = 0;
+	pid_t         pids[BCAST_CONSUMERS];
+	/* the memfd, the writable eventfd, then each consumer's readable one */
+	int           fds[2 + BCAST_CONSUMERS];
+	size_t        fds_len = nelements(fds);
+
+	if (   recv_fds(sockfd, fds, &fds_len) < 0
+	    || fds_len != nelements(fds))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds[0], (char **)&bcast))) {
+		for (size_t i = 0; i < nelements(fds); i++)
+			close(fds[i]);
+		return e;
+	}
+
+	close(fds[0]);
+
+	eprintln("rx whl_bcast_t %p", bcast);
+
+	/* we're consumer 0, each child is another reading the same messages */
+	for (size_t i = 1; i < BCAST_CONSUMERS; i++) {
+		if ((pids[i] = fork()) < 0) {
+			e = err("fork");
+			whl_bcast_leave(bcast, i);
+		} else if (pids[i] == 0) {
+			consumer = i;
+			break;
+		}
+	}
+
+	/* each consumer keeps only its own readable eventfd */
+	for (size_t i = 0; i < BCAST_CONSUMERS; i++)
+		if (i != consumer)
+			close(fds[2 + i]);
+
+	whl_bcast_efd_init_from_eventfds(&efd, bcast, consumer,
+	                                 fds[2 + consumer], fds[1]);
+
+	while (loops--) {
+		while ((offset = whl_bcast_efd_next_shared_slice(&efd, &buf, &bufsize)) == WHL_INVALID_OFFSET)
+			if (iserr(e = wait_fd(efd.readable[consumer], POLLIN))) {
+				/* stop holding up the producer */
+				whl_bcast_leave(bcast, consumer);
+				goto done;
+			}
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_bcast_efd_return_slice(&efd, offset);
+
+		*total += bufsize;
+	}
+
+done:
+	whl_bcast_efd_close(&efd);
+
+	if (consumer != 0) {
+		eprintln("rx bcast consumer %zu done %.3fmb", consumer,
+		         (float)*total / 1024. / 1024.);
+		_exit(0);
+	}
+
+	for (size_t i = 1; i < BCAST_CONSUMERS; i++)
+		if (pids[i] > 0)
+			waitpid(pids[i], NULL, 0);
+
+	close_shm((char *)bcast);
+
+	return e;
+}
+
+/* in memory shared with the forked consumers */
+typedef struct {
+	/* for mpmc, messages got by all the consumers so far */
+	_Atomic uint32_t got;
+	uint32_t         consumer_got[MPMC_THREADS];
+	size_t           consumer_total[MPMC_THREADS];
+	double           consumer_elapsed[MPMC_THREADS];
+} mpmc_stats_t;
+
+/* what each mpmc consumer makes its own whl_mpmc_efd_t from after forking */
+typedef struct {
+	whl_mpmc_t *mpmc;
+	int         readable;
+	int         writable;
+} mpmc_receiver_t;
+
+void
+run_mpmc_consumer(void *shm, mpmc_stats_t *stats, size_t consumer)
+{
+	mpmc_receiver_t *rx = shm;
+	err_t            e;
+	whl_mpmc_efd_t   efd;
+	whl_offset_t     offset;
+	char            *buf;
+	size_t           bufsize;
+
+	/* the epoll instances are this process's, so they're made here */
+	if (whl_mpmc_efd_init_from_eventfds(&efd, rx->mpmc, rx->readable, rx->writable) < 0) {
+		e = err("whl_mpmc_efd_init_from_eventfds");
+		eprintln("rx mpmc consumer %zu " ERRFMT, consumer, errfmtargs(e));
+		close(rx->readable);
+		close(rx->writable);
+		return;
+	}
+
+	while (atomic_load_explicit(&stats->got, memory_order_relaxed) < NLOOPS) {
+		if ((offset = whl_mpmc_efd_next_shared_slice(&efd, &buf, &bufsize)) == WHL_INVALID_OFFSET) {
+			/* a timeout, the last message might go to someone else */
+			if (whl_mpmc_efd_wait_readable(&efd, MPMC_WAIT_MS) < 0) {
+				e = err("whl_mpmc_efd_wait_readable");
+				eprintln("rx mpmc consumer %zu " ERRFMT, consumer, errfmtargs(e));
+				break;
+			}
+			continue;
+		}
+
+		if (!test_buf(buf, bufsize))
+			eprintln("%6u %" WHL_PRIxOFFSET " failed cmp",
+			         stats->consumer_got[consumer], offset);
+
+		whl_mpmc_efd_return_slice(&efd, offset);
+
+		atomic_fetch_add_explicit(&stats->got, 1, memory_order_relaxed);
+		stats->consumer_got[consumer]++;
+		stats->consumer_total[consumer] += bufsize;
+	}
+
+	whl_mpmc_efd_close(&efd);
+}
+
+/* consumer i reads shard i */
+void
+run_shards_consumer(void *shm, mpmc_stats_t *stats, size_t consumer)
+{
+	whl_t        *whl = (whl_t *)((char *)shm + consumer * (WHEEL_SIZE / MPMC_THREADS));
+	uint32_t      loops = NLOOPS / MPMC_THREADS
+	                    + (consumer == 0 ? NLOOPS % MPMC_THREADS : 0);
+	whl_offset_t  offset;
+	char         *buf;
+	size_t        bufsize;
+
+	while (loops--) {
+		while ((offset = whl_next_shared_slice(whl, &buf, &bufsize)) == WHL_INVALID_OFFSET)
+			sched_yield();
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_return_slice(whl, offset);
+
+		stats->consumer_got[consumer]++;
+		stats->consumer_total[consumer] += bufsize;
+	}
+}
+
+/* forks into MPMC_THREADS consumers that each call `run` with their number,
+ * then prints how many messages each got and how fast. fairness is the
+ * slowest consumer's msgs/s over the fastest's. */
+err_t
+run_mpmc_consumers(void *shm, void (*run)(void *, mpmc_stats_t *, size_t),
+                   const char *name, size_t *total)
+{
+	err_t         e = YIPPIE;
+	mpmc_stats_t *stats;
+	size_t        consumer = 0;
+	pid_t         pids[MPMC_THREADS];
+	timespec_t    before, after;
+	double        rate, slowest = 0, fastest = 0;
+
+	stats = mmap(NULL, sizeof(*stats), PROT_READ | PROT_WRITE,
+	             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED)
+		return err("mmap");
+
+	memset(stats, 0, sizeof(*stats));
+
+	clock_gettime(CLOCK_MONOTONIC, &before);
+
+	/* we're consumer 0 */
+	for (size_t i = 1; i < MPMC_THREADS; i++) {
+		if ((pids[i] = fork()) < 0) {
+			e = err("fork");
+			break;
+		} else if (pids[i] == 0) {
+			consumer = i;
+			break;
+		}
+	}
+
+	/* for shards, nobody reads a shard we didn't fork a consumer for */
+	if (!iserr(e) || consumer != 0)
+		run(shm, stats, consumer);
+
+	clock_gettime(CLOCK_MONOTONIC, &after);
+
+	stats->consumer_elapsed[consumer] =
+	          (double)(after.tv_sec - before.tv_sec)
+	        + (double)(after.tv_nsec - before.tv_nsec) / (double)NANOS_PER_SEC;
+
+	if (consumer != 0)
+		_exit(0);
+
+	for (size_t i = 1; i < MPMC_THREADS; i++)
+		if (pids[i] > 0)
+			waitpid(pids[i], NULL, 0);
+
+	for (size_t i = 0; i < MPMC_THREADS; i++) {
+		rate = stats->consumer_got[i] / stats->consumer_elapsed[i];
+		if (i == 0 || rate < slowest)
+			slowest = rate;
+		if (i == 0 || rate > fastest)
+			fastest = rate;
+
+		eprintln("rx %s consumer %zu got %u in %.3fs %.0f msgs/s", name, i,
+		         stats->consumer_got[i], stats->consumer_elapsed[i], rate);
+
+		*total += stats->consumer_total[i];
+	}
+
+	eprintln("rx %s fairness %.2f", name, fastest > 0 ? slowest / fastest : 0);
+
+	munmap(stats, sizeof(*stats));
+
+	return e;
+}
+
+err_t
+_main_receiver_mpmc(int sockfd, size_t *total)
+{
+	union { int a[3]; struct { int mem, read, write; }; } fds;
+
+	err_t           e = YIPPIE;
+	whl_mpmc_t     *mpmc;
+	mpmc_receiver_t rx;
+	size_t          fds_len = nelements(fds.a);
+
+	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
+	    || fds_len != nelements(fds.a))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds.mem, (char **)&mpmc))) {
+		close(fds.mem);
+		close(fds.read);
+		close(fds.write);
+		return e;
+	}
+
+	close(fds.mem);
+
+	eprintln("rx whl_mpmc_t %p", mpmc);
+
+	/* each consumer closes the eventfds when it's done */
+	rx = (mpmc_receiver_t) {
+		.mpmc = mpmc,
+		.readable = fds.read,
+		.writable = fds.write,
+	};
+	e = run_mpmc_consumers(&rx, run_mpmc_consumer, "mpmc", total);
+
+	close_shm((char *)mpmc);
+
+	return e;
+}
+
+err_t
+_main_receiver_shards(int sockfd, size_t *total)
+{
+	err_t  e = YIPPIE;
+	int    memfd;
+	char  *shm;
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_shm(memfd, &shm))) {
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("rx %i whl_t shards %p", MPMC_THREADS, shm);
+
+	e = run_mpmc_consumers(shm, run_shards_consumer, "shards", total);
+
+	close_shm(shm);
+
+	return e;
+}
+
+err_t
+_main_receiver_percpu(int sockfd, size_t *total)
+{
+	uint32_t      loops = NLOOPS;
+	err_t         e = YIPPIE;
+	int           memfd;
+	whl_percpu_t *percpu;
+	whl_offset_t  offset;
+	uint32_t      wheel;
+	uint32_t      got[WHL_PERCPU_MAX] = { 0 };
+	char         *buf;
+	size_t        bufsize;
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_shm(memfd, (char **)&percpu))) {
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("rx whl_percpu_t %p", percpu);
+
+	while (loops--) {
+		/* spin */
+		while ((offset = whl_percpu_next_shared_slice(percpu, &wheel, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_percpu_return_slice(percpu, wheel, offset);
+
+		got[wheel]++;
+		*total += bufsize;
+	}
+
+	for (uint32_t n = 0; n < percpu->count; n++)
+		if (got[n])
+			eprintln("rx percpu wheel %u got %u", n, got[n]);
+
+	close_shm((char *)percpu);
+
+	return YIPPIE;
+}
+
+err_t
+_main_receiver_lossy(int sockfd, size_t *total)
+{
+	err_t             e = YIPPIE;
+	int               memfd;
+	whl_lossy_t      *lossy;
+	whl_lossy_stats_t stats = { 0 };
+	char              buf[SEND_SIZE_MAX];
+	size_t            bufsize;
+	uint32_t          got = 0;
+	timespec_t        pause = { 0, SPILL_PAUSE_NS };
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_shm(memfd, (char **)&lossy))) {
+		close(memfd);
+		return e;
+	}
+
+	close(memfd);
+
+	eprintln("rx whl_lossy_t %p", lossy);
+
+	/* every message is either got or dropped */
+	while (got + stats.dropped < NLOOPS) {
+		/* like a monitoring process that fell behind */
+		if (got % LOSSY_PAUSE_EVERY == LOSSY_PAUSE_EVERY - 1)
+			nanosleep(&pause, NULL);
+
+		/* spin */
+		while (whl_lossy_read(lossy, (byte *)buf, sizeof(buf), &bufsize) != 0);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i failed cmp", got);
+
+		got++;
+		stats = whl_lossy_stats(lossy);
+
+		*total += bufsize;
+	}
+
+	eprintln("rx lossy got %u dropped %lu torn %lu", got, stats.dropped,
+	         stats.torn);
+
+	close_shm((char *)lossy);
+
+	return YIPPIE;
+}
+
+err_t
+_main_receiver_latest(int sockfd, size_t *total)
+{
+	union { int a[2]; struct { int mem, read; }; } fds;
+
+	err_t              e = YIPPIE;
+	whl_latest_t      *latest;
+	whl_latest_efd_t   efd;
+	whl_latest_stats_t stats = { 0 };
+	char               buf[SEND_SIZE_MAX];
+	size_t             bufsize;
+	size_t             fds_len = nelements(fds.a);
+	uint64_t           got = 0;
+
+	if (   recv_fds(sockfd, fds.a, &fds_len) < 0
+	    || fds_len != nelements(fds.a))
+		return err("recv_fds");
+
+	if (iserr(e = open_shm(fds.mem, (char **)&latest))) {
+		close(fds.mem);
+		close(fds.read);
+		return e;
+	}
+
+	close(fds.mem);
+	whl_latest_efd_init_from_eventfd(&efd, latest, fds.read);
+
+	eprintln("rx whl_latest_t %p", latest);
+
+	/* until we've read the last value */
+	while (stats.read < NLOOPS) {
+		while (whl_latest_efd_read(&efd, (byte *)buf, sizeof(buf), &bufsize) != 0)
+			if (iserr(e = wait_fd(efd.readable, POLLIN)))
+				goto done;
+
+		if (!test_buf(buf, bufsize))
+			eprintln("%6lu failed cmp", stats.read);
+
+		got++;
+		stats = whl_latest_stats(latest);
+
+		*total += bufsize;
+	}
+
+	eprintln("rx latest got %lu conflated %lu", stats.read - stats.conflated,
+	         stats.conflated);
+
+	/* each read is a value the consumer didn't get before */
+	if (got != stats.read - stats.conflated)
+		eprintln("rx latest read %lu values but counted %lu", got,
+		         stats.read - stats.conflated);
+
+done:
+	whl_latest_efd_close(&efd);
+	close_shm((char *)latest);
+
+	return e;
+}
+
+void
+run_split_receiver(whl_split_t *split, size_t *total)
+{
+	uint32_t       loops = NLOOPS;
+	whl_consumer_t consumer;
+	whl_offset_t   offset;
+	char          *buf;
+	size_t         bufsize;
+
+	whl_consumer_init(&consumer, split);
+
+	while (loops--) {
+		/* spin */
+		while ((offset = whl_consumer_next_shared_slice(&consumer, &buf, &bufsize)) == WHL_INVALID_OFFSET);
+
+		if (!test_buf(buf, bufsize))
+			eprintln("% 6i %" WHL_PRIxOFFSET " failed cmp", loops, offset);
+
+		whl_consumer_return_slice(&consumer, offset);
+
+		*total += bufsize;
+	}
+}
+
+err_t
+_main_receiver_split(int sockfd, size_t *total)
+{
+	err_t        e = YIPPIE;
+	int          memfd;
+	whl_split_t *split;
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_shm(memfd, (char **)&split))) {
+		close(memfd);
+		return e;
+	}
+
+	eprintln("rx whl_split_t %p", split);
+
+	run_split_receiver(split, total);
+
+	return YIPPIE;
+}
+
+/* the tap watches until `done` is set */
+void
+run_tap(whl_split_t *split, _Atomic int *done)
+{
+	whl_tap_t       tap;
+	whl_tap_stats_t stats;
+	char            buf[SEND_SIZE_MAX];
+	size_t          bufsize;
+
+	whl_tap_init(&tap, split);
+
+	while (!atomic_load_explicit(done, memory_order_relaxed)) {
+		if (whl_tap_read(&tap, (byte *)buf, sizeof(buf), &bufsize) != 0)
+			continue;
+
+		if (!test_buf(buf, bufsize))
+			eprintln("tap failed cmp");
+	}
+
+	stats = whl_tap_stats(&tap);
+	eprintln("rx tap saw %lu lapped %lu torn %lu",
+	         stats.seen, stats.lapped, stats.torn);
+}
+
+err_t
+_main_receiver_tap(int sockfd, size_t *total)
+{
+	err_t        e = YIPPIE;
+	int          memfd;
+	whl_split_t *split;
+	_Atomic int *done;
+	pid_t        pid;
+
+	if (recv_fd(sockfd, &memfd) < 0)
+		return err("recv_fd");
+
+	if (iserr(e = open_shm(memfd, (char **)&split))) {
+		close(memfd);
+		return e;
+	}
+
+	eprintln("rx whl_split_t %p", split);
+
+	/* the tap is in a child process, this tells it we're done */
+	done = mmap(NULL, sizeof(*done), PROT_READ | PROT_WRITE,
+	            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (done == MAP_FAILED)
+		return err("mmap");
+
+	*done = 0;
+
+	if ((pid = fork()) < 0)
+		return err("fork");
+
+	if (pid == 0) {
+		run_tap(split, done);
+		_exit(0);
+	}
+
+	run_split_receiver(split, total);
+
+	atomic_store(done, 1);
+	waitpid(pid, NULL, 0);
+	munmap(done, sizeof(*done));
 
 	return YIPPIE;
 }
@@ -564,9 +2967,47 @@ main_receiver(int sockfd, tport_t tport)
 	if (tport == TPORT_LIBUV)
 		e = _main_receiver_libuv(sockfd, &total);
 	else if (tport == TPORT_SPIN)
-		e = _main_receiver_spin(sockfd, &total);
+		e = _main_receiver_spin(sockfd, &total, run_spin_receiver);
 	else if (tport == TPORT_SEQPACKET)
 		e = _main_receiver_seqpacket(sockfd, &total);
+	else if (tport == TPORT_SPLIT)
+		e = _main_receiver_split(sockfd, &total);
+	else if (tport == TPORT_BATCH)
+		e = _main_receiver_spin(sockfd, &total, run_batch_receiver);
+	else if (tport == TPORT_MIRROR)
+		e = _main_receiver_mirror(sockfd, &total);
+	else if (tport == TPORT_CHAIN)
+		e = _main_receiver_chain(sockfd, &total);
+	else if (tport == TPORT_SPILL)
+		e = _main_receiver_spill(sockfd, &total);
+	else if (tport == TPORT_LANES)
+		e = _main_receiver_lanes(sockfd, &total);
+	else if (tport == TPORT_RING)
+		e = _main_receiver_ring(sockfd, &total);
+	else if (tport == TPORT_SLOTS)
+		e = _main_receiver_slots(sockfd, &total);
+	else if (tport == TPORT_PACK)
+		e = _main_receiver_spin(sockfd, &total, run_pack_receiver);
+	else if (tport == TPORT_LOSSY)
+		e = _main_receiver_lossy(sockfd, &total);
+	else if (tport == TPORT_LATEST)
+		e = _main_receiver_latest(sockfd, &total);
+	else if (tport == TPORT_POOL)
+		e = _main_receiver_spin(sockfd, &total, run_pool_receiver);
+	else if (tport == TPORT_FILL)
+		e = _main_receiver_spin(sockfd, &total, run_spin_receiver);
+	else if (tport == TPORT_MPSC)
+		e = _main_receiver_mpsc(sockfd, &total);
+	else if (tport == TPORT_BCAST)
+		e = _main_receiver_bcast(sockfd, &total);
+	else if (tport == TPORT_TAP)
+		e = _main_receiver_tap(sockfd, &total);
+	else if (tport == TPORT_MPMC)
+		e = _main_receiver_mpmc(sockfd, &total);
+	else if (tport == TPORT_SHARDS)
+		e = _main_receiver_shards(sockfd, &total);
+	else if (tport == TPORT_PERCPU)
+		e = _main_receiver_percpu(sockfd, &total);
 	else
 		return thiserr(EINVAL, "unexpected transport");
 
@@ -576,7 +3017,8 @@ main_receiver(int sockfd, tport_t tport)
 	        + (double)(after.tv_nsec - before.tv_nsec) / (double)NANOS_PER_SEC;
 	println("%f", elapsed);
 
-	eprintln("rx done %.3fmb", (float)total / 1024. / 1024.);
+	eprintln("rx done %.3fmb %.0f msgs/s", (float)total / 1024. / 1024.,
+	         NLOOPS / elapsed);
 
 	return e;
 }
@@ -588,7 +3030,7 @@ main_receiver(int sockfd, tport_t tport)
  * with the first argument to mmap but it didn't seem to do anything, I don't
  * know how any of that works to be honest.) */
 err_t
-_forking_main(char *exe, char *mode)
+_forking_main(char *exe, char *mode, char *align)
 {
 	err_t  e;
 	int    sockpair[2];
@@ -628,7 +3070,7 @@ _forking_main(char *exe, char *mode)
 		waitpid(pidb, NULL, 0);
 	} else {
 		/* either sender or receiver branch */
-		char *args[] = { exe, mode, pida ? "rx" : "tx", "69", 0 };
+		char *args[] = { exe, mode, pida ? "rx" : "tx", "69", align, 0 };
 		if (execve(exe, args, NULL) < 0)
 			return err("execve");
 	}
@@ -665,6 +3107,44 @@ tport_from_str(char *s)
 		return TPORT_SPIN;
 	else if (strcmp(s, "seqpacket") == 0)
 		return TPORT_SEQPACKET;
+	else if (strcmp(s, "split") == 0)
+		return TPORT_SPLIT;
+	else if (strcmp(s, "batch") == 0)
+		return TPORT_BATCH;
+	else if (strcmp(s, "mirror") == 0)
+		return TPORT_MIRROR;
+	else if (strcmp(s, "chain") == 0)
+		return TPORT_CHAIN;
+	else if (strcmp(s, "spill") == 0)
+		return TPORT_SPILL;
+	else if (strcmp(s, "lanes") == 0)
+		return TPORT_LANES;
+	else if (strcmp(s, "ring") == 0)
+		return TPORT_RING;
+	else if (strcmp(s, "slots") == 0)
+		return TPORT_SLOTS;
+	else if (strcmp(s, "pack") == 0)
+		return TPORT_PACK;
+	else if (strcmp(s, "lossy") == 0)
+		return TPORT_LOSSY;
+	else if (strcmp(s, "latest") == 0)
+		return TPORT_LATEST;
+	else if (strcmp(s, "pool") == 0)
+		return TPORT_POOL;
+	else if (strcmp(s, "fill") == 0)
+		return TPORT_FILL;
+	else if (strcmp(s, "mpsc") == 0)
+		return TPORT_MPSC;
+	else if (strcmp(s, "bcast") == 0)
+		return TPORT_BCAST;
+	else if (strcmp(s, "tap") == 0)
+		return TPORT_TAP;
+	else if (strcmp(s, "mpmc") == 0)
+		return TPORT_MPMC;
+	else if (strcmp(s, "shards") == 0)
+		return TPORT_SHARDS;
+	else if (strcmp(s, "percpu") == 0)
+		return TPORT_PERCPU;
 	else
 		return __TPORT_COUNT;
 }
@@ -676,16 +3156,19 @@ main(int argc, char *argv[])
 
 	switch (argc) {
 		case 1:
-			e = _forking_main(argv[0], "uv");
+			e = _forking_main(argv[0], "uv", 0);
 			break;
 		case 2:
-			/* tport */
+		case 3:
+			/* tport [align] */
 			if (!(tport_from_str(argv[1]) < __TPORT_COUNT))
 				goto usage;
-			e = _forking_main(argv[0], argv[1]);
+			e = _forking_main(argv[0], argv[1], argv[2]);
 			break;
+		case 5:
+			slice_align = atoi(argv[4]);
 		case 4:
-			/* tport rx|tx fd */
+			/* tport rx|tx fd [align] */
 			if (strcmp(argv[2], "tx") == 0) {
 				e = main_sender(atoi(argv[3]), tport_from_str(argv[1]));
 				break;
@@ -695,7 +3178,7 @@ main(int argc, char *argv[])
 			}
 		default:
 		usage:
-			eprintln("usage: %s [<uv|spin|seqpacket> [<rx|tx> <fd>]]", argv[0]);
+			eprintln("usage: %s [<uv|spin|split|batch|mirror|chain|spill|lanes|ring|slots|pack|lossy|latest|pool|fill|mpsc|bcast|tap|mpmc|shards|percpu|seqpacket> [<rx|tx> <fd>] [<align>]]", argv[0]);
 			return 1;
 	}
 
@@ -5,6 +5,11 @@
  * writer:
  * - `whl_make_slice()` finds a free slice of the requested size
  * - `whl_share_slice()` makes that slice gettable in the next step
+ * - `whl_commit_slice()` optionally shrinks the slice before sharing it,
+ *   if it was made bigger than it needed, or `whl_abort_slice()` gives it
+ *   back instead of sharing it
+ * - `whl_grow_slice()` makes the slice bigger in place while there's room,
+ *   for writing something before knowing its size
  *
  * reader:
  * - `whl_next_shared_slice()` gets the earliest shared slice
@@ -15,13 +20,17 @@
  *   the buffer reserved for the memory wheel. use either:
  * 1. `whl_init()` to spin on it.
  *    Initialize in only one process and cast in the other.
+ *    `whl_init_aligned()` does the same with a slice alignment other than 64.
  * 2. `whl_atomic_init()` to poll on file descriptors.
  *    Similarly, use `whl_atomic_init()` in one process and cast in the other.
  *    But, also use `whl_efd_init()` in non-shared memory to create file
  *    descriptors in one process, access them with `whl_efd_fds()`, duplicate
  *    them to another process having a different file descriptor table, and use
- *    `whl_efd_init_from_eventfds()` there. */
+ *    `whl_efd_init_from_eventfds()` there.
+ * 3. `whl_split_init()` to spin on a `whl_split_t` that keeps the producer's
+ *    and consumer's state on separate cache lines. see further below. */
 #include <assert.h>
+#include <inttypes.h>
 #include <stdatomic.h>
 #include <sys/eventfd.h>
 
@@ -30,143 +39,1275 @@ typedef uint16_t  u16;
 typedef uint32_t  u32;
 typedef uint64_t  u64;
 typedef char      byte;
-typedef uint32_t  whl_offset_t;
+
+#ifdef WHL_OFFSET64
+
+/* defining WHL_OFFSET64 before including this makes offsets 64 bits, so a
+ * wheel can be as big as you can map, at any alignment. `whl_t` then compares
+ * and exchanges head and last as 16 bytes, `whl_init()` fails if that isn't
+ * lock free. clang does it with -mcx16, gcc goes through libatomic and never
+ * says it's lock free. */
+typedef uint64_t          whl_offset_t;
+typedef unsigned __int128 whl_offset_pair_word_t;
+
+#define WHL_INVALID_OFFSET      UINT64_MAX
+#define WHL_INVALID_OFFSET_PAIR (~(whl_offset_pair_word_t)0)
+/* for printing a whl_offset_t */
+#define WHL_PRIxOFFSET          PRIx64
+
+#else
+
+typedef uint32_t          whl_offset_t;
+typedef uint64_t          whl_offset_pair_word_t;
 
 #define WHL_INVALID_OFFSET      UINT32_MAX
 #define WHL_INVALID_OFFSET_PAIR UINT64_MAX
+#define WHL_PRIxOFFSET          PRIx32
+
+#endif // WHL_OFFSET64
+
 /* 64 is a reasonable guess for cache line size?
- * also 64*UINT32_MAX allows for like 250GBish */
+ * also 64*UINT32_MAX allows for like 250GBish, or see WHL_OFFSET64 */
 #define WHL_ALIGN               64
+/* the range of granularities for `whl_init_aligned()`, smaller packs small
+ * messages tighter, 128 keeps slices on pairs of lines for adjacent-line
+ * prefetchers */
+#define WHL_ALIGN_MIN           8
+#define WHL_ALIGN_MAX           128
+
+#define __whl_affirm(c)   while (!(c)) __builtin_unreachable()
+#define __whl_staticassert(desc, test) \
+	const char __static_assert ## desc [(test) ? 0 : -1]
+
+typedef enum {
+	WHL_SLICE_UNINIT   = 0x0,
+	WHL_SLICE_READABLE = 0x1,
+	WHL_SLICE_RETURNED = 0x2,
+	/* only takes up room at the end of the buffer because the next slice
+	 * didn't fit there, `whl_split_t` consumers step over these */
+	WHL_SLICE_PADDING  = 0x3,
+} whl_slice_state_e;
+
+#ifdef WHL_COMPACT_SLICE
+
+/* defining WHL_COMPACT_SLICE before including this packs the slice header into
+ * 8 bytes, so a slice's state, size and span are written with one store and
+ * read with one load. sizes are limited to UINT32_MAX and spans to
+ * WHL_SPAN_MAX units of the wheel's alignment.
+ *
+ * `whl_t` doesn't backfill the last slice before wrapping around either, the
+ * end of it goes in `whl_spin_t` `wrap` instead. */
+typedef struct whl_slice {
+	/* from the low bits up:
+	 * - 2 bits of whl_slice_state_e
+	 * - 30 bits of aligned size in wheel
+	 * - 32 bits of user size */
+	_Atomic u64 word;
+} whl_slice_t;
+
+#define WHL_SPAN_MAX       ((whl_offset_t)0x3fffffff)
+#define WHL_SLICE_SIZE_MAX ((size_t)UINT32_MAX)
+
+#else
+
+typedef struct whl_slice {
+	/* the size in bytes the user requested, at least this many bytes is
+	 * reserved for this slice in the memory immediately following the slice's
+	 * header */
+	size_t               user_size;
+	/* the wheel's alignment * aligned_size_in_wheel >= user_size */
+	_Atomic whl_offset_t aligned_size_in_wheel;
+	_Atomic u8           state;
+} whl_slice_t;
+
+#define WHL_SPAN_MAX       ((whl_offset_t)WHL_INVALID_OFFSET - 1)
+#define WHL_SLICE_SIZE_MAX SIZE_MAX
+
+#endif // WHL_COMPACT_SLICE
+
+typedef union {
+	struct {
+		whl_offset_t head;
+		whl_offset_t last;
+	};
+	whl_offset_pair_word_t word;
+} whl_offset_pair_t;
+
+typedef union {
+	struct {
+		u8 u8a;
+		u8 u8b;
+	};
+	u16 u16;
+} whl_u8_pair_t;
+
+const whl_offset_pair_t whl_invalid_offset_pair =
+	{ .word = WHL_INVALID_OFFSET_PAIR };
+
+/* split producer and consumer
+ *
+ * `whl_spin_t` keeps head and last in one word that both ends compare and
+ * exchange, so every message moves that cache line between the two ends.
+ *
+ * `whl_split_t` instead gives the producer and the consumer a cache line each
+ * and only ever has one end write to a line. positions are byte counts since
+ * `whl_split_init()` that only increase. the offset of a position in the buffer
+ * is the position modulo the buffer size. the buffer is empty when
+ * head == tail and full when tail - head == size. neither end ever compares
+ * and exchanges, they only store their own position and load the other's.
+ *
+ * each end uses its own `whl_producer_t` or `whl_consumer_t` in non-shared
+ * memory that remembers the other end's position from the last time it was
+ * read. the shared line is only read again when that remembered position
+ * makes the wheel look full (for the producer) or empty (for the consumer).
+ *
+ * writer:
+ * - `whl_producer_make_slice()`
+ * - `whl_producer_share_slice()`
+ *
+ * reader:
+ * - `whl_consumer_next_shared_slice()`
+ * - `whl_consumer_return_slice()`
+ *
+ * initialization:
+ * - `whl_split_init()` in shared memory in one process
+ * - `whl_producer_init()` in the writing process and `whl_consumer_init()`
+ *   in the reading process
+ *
+ * defining WHL_SPLIT before including this makes `whl_t` a `whl_split_t` and
+ * `whl_init()`, `whl_make_slice()` and the rest use it, so the `whl_atomic_t`
+ * and `whl_efd_t` functions do too. then each end's copy lives on that end's
+ * line in shared memory, which no one else writes to either. */
+
+/* the line size we try to keep the ends apart by */
+#define WHL_CACHE_LINE        64
+/* a line for the size, the producer, the consumer,
+ * and the guards that `whl_atomic_t` adds */
+#define WHL_SPLIT_HEADER_SIZE (4 * WHL_CACHE_LINE)
+
+/* what one end of a `whl_split_t` keeps to itself */
+typedef struct {
+	/* the producer's position after the most recently made slice, ahead of
+	 * tail by however many slices are made but not shared */
+	u64 reserved;
+	/* the producer's is what it last stored to split->tail,
+	 * the consumer's is what it last loaded */
+	u64 tail;
+	/* the consumer's is what it last stored to split->head,
+	 * the producer's is what it last loaded */
+	u64 head;
+} whl_split_view_t;
+
+/* lives in shared memory */
+typedef struct {
+	/* the size in bytes of the usable buffer in memory following,
+	 * read-only after `whl_split_init()` */
+	u64              size;
+	/* log2 of the alignment of slices in bytes */
+	u8               align_shift;
+	/* if the buffer is mapped twice in a row, see `whl_init_mirrored()` */
+	u8               mirrored;
+	/* how far the buffer is after the start of this */
+	u32              buf_offset;
+	/* written by the producer,
+	 * the position after the most recent shared slice */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64      tail;
+	/* only used by the producer with WHL_SPLIT */
+	whl_split_view_t producer;
+	/* written by the consumer,
+	 * the position of the oldest slice not returned */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64      head;
+	/* only used by the consumer with WHL_SPLIT */
+	whl_split_view_t consumer;
+} whl_split_t;
+
+/* a copy for the producing process, in non-shared memory */
+typedef struct {
+	whl_split_t     *split;
+	whl_split_view_t view;
+} whl_producer_t;
+
+/* a copy for the consuming process, in non-shared memory */
+typedef struct {
+	whl_split_t     *split;
+	whl_split_view_t view;
+} whl_consumer_t;
+
+/* see `whl_iter_shared_slices()` */
+typedef struct {
+	/* the position of the next slice to look at */
+	u64 pos;
+	/* split->tail when the iteration started */
+	u64 tail;
+} whl_split_iter_t;
+
+#define __whl_split_buf(split)  ((byte *)(split) + (split)->buf_offset)
+#define WHL_INVALID_POS         UINT64_MAX
+
+#ifdef WHL_SPLIT
+
+typedef whl_split_t whl_spin_t;
+typedef whl_split_iter_t whl_iter_t;
+
+#define WHL_HEADER_SIZE WHL_SPLIT_HEADER_SIZE
+
+#else
+
+/* lives in shared memory */
+typedef struct {
+	/* the size of the usable buffer in memory following */
+	whl_offset_t aligned_size;
+	/* log2 of the alignment of slices in bytes, offsets and sizes in the
+	 * wheel are in units of that */
+	u8           align_shift;
+	/* if the buffer is mapped twice in a row, see `whl_init_mirrored()` */
+	u8           mirrored;
+	/* how far the buffer is after the start of this */
+	u32          buf_offset;
+#ifdef WHL_COMPACT_SLICE
+	/* the end of the last slice before the producer wrapped around to the
+	 * start, the consumer goes back to the start from there. or
+	 * WHL_INVALID_OFFSET once a slice is made there */
+	_Atomic whl_offset_t wrap;
+#endif
+	union {
+		struct {
+			/* head is the oldest slice that is "allocated" and not returned,
+			 * or WHL_INVALID_OFFSET if no such slice */
+			_Atomic whl_offset_t head;
+			/* last is the most recent slice "allocated" and not returned,
+			 * or WHL_INVALID_OFFSET if no such slice */
+			_Atomic whl_offset_t last;
+		};
+		_Atomic whl_offset_pair_t head_last;
+	};
+} whl_spin_t;
+
+/* see `whl_iter_shared_slices()` */
+typedef struct {
+	/* the next slice to look at,
+	 * or WHL_INVALID_OFFSET once we're past `last` */
+	whl_offset_t offset;
+	/* the most recent slice made when the iteration started */
+	whl_offset_t last;
+} whl_iter_t;
+
+#define WHL_HEADER_SIZE WHL_ALIGN
+
+#endif // WHL_SPLIT
+
+/* lives in shared memory */
+typedef struct {
+	whl_spin_t spin;
+	union {
+		struct {
+			_Atomic u8 readable_guard;
+			/* initially 0. set to 1 when a slice is shared. */
+			_Atomic u8 is_readable;
+		};
+		_Atomic whl_u8_pair_t readable_state;
+	};
+	union {
+		struct {
+			_Atomic u8 writable_guard;
+			/* initially 1. set to 0 when making a slice fails. */
+			_Atomic u8 is_writable;
+		};
+		_Atomic whl_u8_pair_t writable_state;
+	};
+} whl_atomic_t;
+
+/* I don't know if this is really important */
+#ifdef WHL_COMPACT_SLICE
+__whl_staticassert(whl_slice_t_sizeof, sizeof(whl_slice_t) == 8);
+#elif defined(WHL_OFFSET64)
+__whl_staticassert(whl_slice_t_sizeof, sizeof(whl_slice_t) == 24);
+#else
+__whl_staticassert(whl_slice_t_sizeof, sizeof(whl_slice_t) == 16);
+#endif
+/* whl_spin_t and whl_atomic_t do need to be <= WHL_HEADER_SIZE because
+ * of whl_init only reserves WHL_HEADER_SIZE room for the wheel header.
+ * it would almost be fine to accept a variable size and pad it
+ * but __whl_buf() would have to change */
+__whl_staticassert(whl_spin_t_sizeof, sizeof(whl_spin_t) <= WHL_HEADER_SIZE);
+__whl_staticassert(whl_aotmic_t_sizeof, sizeof(whl_atomic_t) <= WHL_HEADER_SIZE);
+__whl_staticassert(whl_split_t_sizeof, sizeof(whl_split_t) <= WHL_SPLIT_HEADER_SIZE);
+
+/* a copy for each process with different file descriptor table or virtual
+ * address space */
+typedef struct {
+	whl_atomic_t *atomic;
+	/* a file descriptor that polls readable when at least one message is
+	 * shared and not yet taken */
+	int           readable;
+	/* a file descriptor that polls writable when there might be room for
+	 * message */
+	int           writable;
+} whl_efd_t;
+
+typedef whl_spin_t whl_t;
+
+/* for `whl_t` or `whl_split_t`, the alignment is a power of two so these
+ * are all shifts and masks */
+#define __whl_align(wheel)          ((u64)1 << (wheel)->align_shift)
+#define __whl_aligned(wheel, sz)    (((u64)(sz) + __whl_align(wheel) - 1) \
+                                     & ~(__whl_align(wheel) - 1))
+/* the buffer starts after the header, or after one unit if that's bigger */
+#define __whl_header_size(align)    ((align) > WHL_HEADER_SIZE ? (align) : WHL_HEADER_SIZE)
+#define __whl_buf(wheel)            ((byte *)(wheel) + (wheel)->buf_offset)
+#define __whl_slice_buf(slice)      ((byte *)(((whl_slice_t *)(slice)) + 1))
+
+/* slice header access, everything else goes through these so it doesn't care
+ * whether WHL_COMPACT_SLICE is defined.
+ *
+ * only the end that the state says owns the slice changes it, the producer
+ * until it's shared and the consumer after. so setting the state doesn't need
+ * a read-modify-write even when it shares a word with the sizes */
+#ifdef WHL_COMPACT_SLICE
+
+#define __whl_slice_word(size, span, state) \
+	((u64)(size) << 32 | (u64)(span) << 2 | (u64)(state))
+
+/* returns the state, and the user size in *size if it's not NULL */
+u8
+__whl_slice_load(whl_slice_t *slice, size_t *size, memory_order order)
+{
+	u64 word = atomic_load_explicit(&slice->word, order);
+	if (size)
+		*size = word >> 32;
+	return word & 0x3;
+}
+
+/* the number of units of the wheel's alignment that the slice takes */
+whl_offset_t
+__whl_slice_span(whl_slice_t *slice)
+{
+	return (atomic_load_explicit(&slice->word, memory_order_relaxed) >> 2)
+	       & WHL_SPAN_MAX;
+}
+
+void
+__whl_slice_store(whl_slice_t *slice, size_t size, whl_offset_t span,
+                  u8 state, memory_order order)
+{
+	atomic_store_explicit(&slice->word, __whl_slice_word(size, span, state),
+	                      order);
+}
+
+void
+__whl_slice_set_state(whl_slice_t *slice, u8 state, memory_order order)
+{
+	u64 word = atomic_load_explicit(&slice->word, memory_order_relaxed);
+	atomic_store_explicit(&slice->word, (word & ~(u64)0x3) | state, order);
+}
+
+/* returns the previous state */
+u8
+__whl_slice_exchange_state(whl_slice_t *slice, u8 state)
+{
+	u64 word = atomic_load_explicit(&slice->word, memory_order_relaxed);
+	return atomic_exchange(&slice->word, (word & ~(u64)0x3) | state) & 0x3;
+}
+
+#else
+
+/* returns the state, and the user size in *size if it's not NULL */
+u8
+__whl_slice_load(whl_slice_t *slice, size_t *size, memory_order order)
+{
+	u8 state = atomic_load_explicit(&slice->state, order);
+	if (size)
+		*size = slice->user_size;
+	return state;
+}
+
+/* the number of units of the wheel's alignment that the slice takes */
+whl_offset_t
+__whl_slice_span(whl_slice_t *slice)
+{
+	return atomic_load_explicit(&slice->aligned_size_in_wheel,
+	                            memory_order_relaxed);
+}
+
+void
+__whl_slice_store(whl_slice_t *slice, size_t size, whl_offset_t span,
+                  u8 state, memory_order order)
+{
+	slice->user_size = size;
+	atomic_store_explicit(&slice->aligned_size_in_wheel, span,
+	                      memory_order_relaxed);
+	atomic_store_explicit(&slice->state, state, order);
+}
+
+void
+__whl_slice_set_state(whl_slice_t *slice, u8 state, memory_order order)
+{
+	atomic_store_explicit(&slice->state, state, order);
+}
+
+/* returns the previous state */
+u8
+__whl_slice_exchange_state(whl_slice_t *slice, u8 state)
+{
+	return atomic_exchange(&slice->state, state);
+}
+
+#endif // WHL_COMPACT_SLICE
+
+int
+__whl_efd_write(int efd, uint64_t v)
+{
+	ssize_t r;
+	do {
+		r = write(efd, &v, sizeof(v));
+	} while (r < 0 && errno == EINTR);
+	return r == sizeof(v);
+}
+
+int
+__whl_efd_read(int efd)
+{
+	uint64_t v;
+	ssize_t  r;
+	do {
+		r = read(efd, &v, sizeof(v));
+	} while (r < 0 && errno == EINTR);
+	return r == sizeof(v);
+}
+
+/* log2 of `align` if it's a power of two from WHL_ALIGN_MIN to WHL_ALIGN_MAX,
+ * otherwise -1 */
+int
+__whl_align_shift(size_t align)
+{
+	if (   align < WHL_ALIGN_MIN
+	    || align > WHL_ALIGN_MAX
+	    || (align & (align - 1)) != 0)
+		return -1;
+
+	return __builtin_ctzl(align);
+}
+
+/* initializes the header for a buffer of `buf_size` bytes starting `buf_offset`
+ * bytes after `split` */
+int
+__whl_split_init(whl_split_t *split, size_t buf_offset, size_t buf_size,
+                 size_t align, u8 mirrored)
+{
+	int shift = __whl_align_shift(align);
+
+	if (   shift < 0
+	    || buf_size < WHL_ALIGN
+	    || buf_size % align != 0
+	    || buf_size >> shift > WHL_SPAN_MAX)
+		return -1;
+
+	*split = (whl_split_t) {
+		.size = buf_size,
+		.align_shift = shift,
+		.mirrored = mirrored,
+		.buf_offset = buf_offset,
+		.tail = 0,
+		.head = 0,
+	};
+	return 0;
+}
+
+/* like `whl_split_init()` but slices are aligned to `align` bytes instead of
+ * WHL_ALIGN, see `whl_init_aligned()`.
+ *
+ * `buf_size` must be a multiple of `align` and leave at least 64 bytes after
+ * the `whl_split_t` header.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_split_init_aligned(whl_split_t *split, size_t buf_size, size_t align)
+{
+	if (buf_size < WHL_SPLIT_HEADER_SIZE)
+		return -1;
+
+	return __whl_split_init(split, WHL_SPLIT_HEADER_SIZE,
+	                        buf_size - WHL_SPLIT_HEADER_SIZE, align, 0);
+}
+
+/* `whl_init_mirrored()` for a `whl_split_t`, slices never have to pad out the
+ * end of the buffer */
+int
+whl_split_init_mirrored(whl_split_t *split, size_t buf_size, size_t align)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	if (buf_size <= page || buf_size % page != 0 || align > page)
+		return -1;
+
+	return __whl_split_init(split, page, buf_size - page, align, 1);
+}
+
+/* `split` must point to allocated memory at least `buf_size` big.
+ * `buf_size` must be a multiple of 64 and leave at least 64 bytes after the
+ * `whl_split_t` header.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_split_init(whl_split_t *split, size_t buf_size)
+{
+	return whl_split_init_aligned(split, buf_size, WHL_ALIGN);
+}
+
+void
+__whl_split_view_init(whl_split_view_t *view, whl_split_t *split)
+{
+	u64 tail = atomic_load(&split->tail);
+	*view = (whl_split_view_t) {
+		.reserved = tail,
+		.tail = tail,
+		.head = atomic_load(&split->head),
+	};
+}
+
+/* `split` is already initialized by `whl_split_init()`, probably by the other
+ * process. only one producer per `whl_split_t`. */
+void
+whl_producer_init(whl_producer_t *producer, whl_split_t *split)
+{
+	producer->split = split;
+	__whl_split_view_init(&producer->view, split);
+}
+
+/* `split` is already initialized by `whl_split_init()`, probably by the other
+ * process. only one consumer per `whl_split_t`. */
+void
+whl_consumer_init(whl_consumer_t *consumer, whl_split_t *split)
+{
+	consumer->split = split;
+	__whl_split_view_init(&consumer->view, split);
+}
+
+whl_slice_t *
+__whl_split_at(whl_split_t *split, u64 pos)
+{
+	return (whl_slice_t *)(__whl_split_buf(split) + pos % split->size);
+}
+
+whl_slice_t *
+__whl_split_slice(whl_split_t *split, whl_offset_t offset)
+{
+	return (whl_slice_t *)(__whl_split_buf(split)
+	                       + ((u64)offset << split->align_shift));
+}
+
+/* the number of bytes in the buffer a slice takes */
+u64
+__whl_split_span(whl_split_t *split, whl_slice_t *slice)
+{
+	return (u64)__whl_slice_span(slice) << split->align_shift;
+}
+
+/* the span for a slice of `size` put at `off` in the buffer. if it would end
+ * too close to the end of the buffer for a padding slice's header to fit
+ * after it, it takes up the rest of the buffer so it doesn't have to */
+u64
+__whl_split_fit(whl_split_t *split, u64 off, size_t size)
+{
+	u64 span = __whl_aligned(split, sizeof(whl_slice_t) + size);
+
+	if (   !split->mirrored
+	    && off + span < split->size
+	    && split->size - off - span < sizeof(whl_slice_t))
+		return split->size - off;
+
+	return span;
+}
+
+whl_offset_t
+__whl_split_make_slice(whl_split_t *split, whl_split_view_t *view,
+                       byte **bufp, size_t size)
+{
+	u64 span = __whl_aligned(split, sizeof(whl_slice_t) + size);
+	u64 off = view->reserved % split->size;
+	u64 pad = 0;
+	u64 need;
+
+	if (span > split->size || size > WHL_SLICE_SIZE_MAX)
+		return WHL_INVALID_OFFSET;
+
+	/* if the slice doesn't fit before the end of the buffer, pad out to the
+	 * end and put it at the start. unless it's mirrored, then it just keeps
+	 * going into the second mapping */
+	if (!split->mirrored && span > split->size - off) {
+		pad = split->size - off;
+		off = 0;
+	}
+
+	span = __whl_split_fit(split, off, size);
+	need = pad + span;
+
+	/* only look at the consumer's line if it looks like we're full */
+	if (view->reserved + need - view->head > split->size) {
+		view->head = atomic_load_explicit(&split->head, memory_order_acquire);
+		if (view->reserved + need - view->head > split->size)
+			return WHL_INVALID_OFFSET;
+	}
+
+	if (pad)
+		__whl_slice_store(__whl_split_at(split, view->reserved),
+		                  0, pad >> split->align_shift, WHL_SLICE_PADDING,
+		                  memory_order_relaxed);
+
+	whl_slice_t *slice = __whl_split_at(split, view->reserved + pad);
+
+	__whl_slice_store(slice, size, span >> split->align_shift,
+	                  WHL_SLICE_UNINIT, memory_order_relaxed);
+
+	view->reserved += need;
+
+	*bufp = __whl_slice_buf(slice);
+
+	return off >> split->align_shift;
+}
+
+/* the position after a made slice */
+u64
+__whl_split_end(whl_split_t *split, whl_split_view_t *view,
+                whl_offset_t offset)
+{
+	/* how far back from the reserved position this slice starts,
+	 * a slice starting at the reserved offset must be a whole wheel back */
+	u64 back = (view->reserved % split->size + split->size
+	            - ((u64)offset << split->align_shift)) % split->size;
+	return view->reserved
+	     - (back ? back : split->size)
+	     + __whl_split_span(split, __whl_split_slice(split, offset));
+}
+
+size_t
+__whl_split_make_slices(whl_split_t *split, whl_split_view_t *view,
+                        whl_offset_t *offsets, byte **bufps,
+                        const size_t *sizes, size_t n)
+{
+	size_t made = 0;
+
+	while (   made < n
+	       && (offsets[made] = __whl_split_make_slice(split, view,
+	                                                  &bufps[made],
+	                                                  sizes[made]))
+	          != WHL_INVALID_OFFSET)
+		made++;
+
+	return made;
+}
+
+void
+__whl_split_share_slice(whl_split_t *split, whl_split_view_t *view,
+                        whl_offset_t offset)
+{
+	whl_slice_t *slice = __whl_split_slice(split, offset);
+	u64          end = __whl_split_end(split, view, offset);
+
+	if (end > view->tail) {
+		/* the release on tail publishes the state too */
+		__whl_slice_set_state(slice, WHL_SLICE_READABLE, memory_order_relaxed);
+		atomic_store_explicit(&split->tail, end, memory_order_release);
+		view->tail = end;
+	} else {
+		/* an earlier slice than one already shared, the consumer can already
+		 * see up to here so the state alone says it's readable */
+		__whl_slice_set_state(slice, WHL_SLICE_READABLE, memory_order_release);
+	}
+}
+
+void
+__whl_split_share_slices(whl_split_t *split, whl_split_view_t *view,
+                         const whl_offset_t *offsets, size_t n)
+{
+	if (!n)
+		return;
+
+	u64 end = __whl_split_end(split, view, offsets[n - 1]);
+
+	if (end > view->tail) {
+		/* one release on tail publishes all their states */
+		while (n--)
+			__whl_slice_set_state(__whl_split_slice(split, offsets[n]),
+			                      WHL_SLICE_READABLE, memory_order_relaxed);
+		atomic_store_explicit(&split->tail, end, memory_order_release);
+		view->tail = end;
+	} else {
+		/* same as `whl_share_slices` */
+		while (--n)
+			__whl_slice_set_state(__whl_split_slice(split, offsets[n]),
+			                      WHL_SLICE_READABLE, memory_order_relaxed);
+		__whl_slice_set_state(__whl_split_slice(split, offsets[0]),
+		                      WHL_SLICE_READABLE, memory_order_release);
+	}
+}
+
+/* the position of the slice at `offset` if it's the most recently made and
+ * not shared yet, otherwise WHL_INVALID_POS */
+u64
+__whl_split_unshared_last(whl_split_t *split, whl_split_view_t *view,
+                          whl_offset_t offset)
+{
+	whl_slice_t *slice = __whl_split_slice(split, offset);
+	u64          pos = view->reserved - __whl_split_span(split, slice);
+
+	if (   view->reserved == view->tail
+	    || __whl_split_at(split, pos) != slice
+	    || __whl_slice_load(slice, NULL, memory_order_relaxed)
+	       != WHL_SLICE_UNINIT)
+		return WHL_INVALID_POS;
+
+	return pos;
+}
+
+int
+__whl_split_commit_slice(whl_split_t *split, whl_split_view_t *view,
+                         whl_offset_t offset, size_t size)
+{
+	whl_slice_t *slice = __whl_split_slice(split, offset);
+	u64          pos = __whl_split_unshared_last(split, view, offset);
+	size_t       user_size;
+	u64          span;
+
+	if (pos == WHL_INVALID_POS)
+		return -1;
+
+	__whl_slice_load(slice, &user_size, memory_order_relaxed);
+
+	if (size > user_size)
+		return -1;
+
+	span = __whl_split_fit(split, pos % split->size, size);
+
+	/* the tail is before this slice so the consumer can't see it yet */
+	__whl_slice_store(slice, size, span >> split->align_shift,
+	                  WHL_SLICE_UNINIT, memory_order_relaxed);
+	view->reserved = pos + span;
+	return 0;
+}
+
+int
+__whl_split_abort_slice(whl_split_t *split, whl_split_view_t *view,
+                        whl_offset_t offset)
+{
+	u64 pos = __whl_split_unshared_last(split, view, offset);
+
+	if (pos == WHL_INVALID_POS)
+		return -1;
+
+	/* if it was put at the start after padding out the end, the padding stays
+	 * and the next slice goes at the start instead */
+	view->reserved = pos;
+	return 0;
+}
+
+int
+__whl_split_grow_slice(whl_split_t *split, whl_split_view_t *view,
+                       whl_offset_t offset, size_t size)
+{
+	whl_slice_t *slice = __whl_split_slice(split, offset);
+	u64          pos = __whl_split_unshared_last(split, view, offset);
+	size_t       user_size;
+	u64          span;
+
+	if (pos == WHL_INVALID_POS || size > WHL_SLICE_SIZE_MAX)
+		return -1;
+
+	__whl_slice_load(slice, &user_size, memory_order_relaxed);
+
+	if (size < user_size)
+		return -1;
+
+	/* it can't wrap, the buffer has to stay in one piece */
+	if (   !split->mirrored
+	    &&   __whl_aligned(split, sizeof(whl_slice_t) + size)
+	       > split->size - pos % split->size)
+		return -1;
+
+	span = __whl_split_fit(split, pos % split->size, size);
+
+	if (pos + span - view->head > split->size) {
+		view->head = atomic_load_explicit(&split->head, memory_order_acquire);
+		if (pos + span - view->head > split->size)
+			return -1;
+	}
+
+	__whl_slice_store(slice, size, span >> split->align_shift,
+	                  WHL_SLICE_UNINIT, memory_order_relaxed);
+	view->reserved = pos + span;
+	return 0;
+}
+
+/* is there a slice at the consumer's head, only looks at the producer's line if
+ * the cached tail says there isn't */
+int
+__whl_split_any(whl_split_t *split, whl_split_view_t *view)
+{
+	if (view->head == view->tail)
+		view->tail = atomic_load_explicit(&split->tail, memory_order_acquire);
+	return view->head != view->tail;
+}
+
+whl_offset_t
+__whl_split_next_shared_slice(whl_split_t *split, whl_split_view_t *view,
+                              byte **bufp, size_t *size)
+{
+	whl_slice_t *slice;
+	size_t       user_size;
+	u8           state;
+
+	while (__whl_split_any(split, view)) {
+
+		slice = __whl_split_at(split, view->head);
+		state = __whl_slice_load(slice, &user_size, memory_order_acquire);
+
+		if (state == WHL_SLICE_PADDING) {
+			view->head += __whl_split_span(split, slice);
+			atomic_store_explicit(&split->head, view->head,
+			                      memory_order_release);
+			continue;
+		}
+
+		if (state != WHL_SLICE_READABLE)
+			break;
+
+		*bufp = __whl_slice_buf(slice);
+		*size = user_size;
+		return (view->head % split->size) >> split->align_shift;
+	}
+
+	return WHL_INVALID_OFFSET;
+}
+
+/* after the consumer's head moved, moves it over anything returned out of order
+ * that was waiting on it, then stores it.
+ *
+ * returns the number of returned slices it moved over */
+size_t
+__whl_split_reclaim(whl_split_t *split, whl_split_view_t *view)
+{
+	whl_slice_t *slice;
+	size_t       returns = 0;
+	u8           state;
+
+	while (__whl_split_any(split, view)) {
+		slice = __whl_split_at(split, view->head);
+		state = __whl_slice_load(slice, NULL, memory_order_acquire);
+
+		if (state != WHL_SLICE_RETURNED && state != WHL_SLICE_PADDING)
+			break;
+
+		view->head += __whl_split_span(split, slice);
+		returns += state == WHL_SLICE_RETURNED;
+	}
+
+	/* the release hands the slices' memory back to the producer after we're
+	 * done reading it */
+	atomic_store_explicit(&split->head, view->head, memory_order_release);
+
+	return returns;
+}
+
+size_t
+__whl_split_return_slice(whl_split_t *split, whl_split_view_t *view,
+                         whl_offset_t offset)
+{
+	whl_slice_t *slice = __whl_split_slice(split, offset);
+	whl_slice_t *at_head;
+
+	/* iterating steps over padding without moving the head, so there can be
+	 * some at the head before this slice. nothing moves the head over it
+	 * later if this slice waits behind it */
+	while (   (at_head = __whl_split_at(split, view->head)) != slice
+	       && __whl_split_any(split, view)
+	       && __whl_slice_load(at_head, NULL, memory_order_acquire)
+	          == WHL_SLICE_PADDING)
+		view->head += __whl_split_span(split, at_head);
+
+	if (slice != at_head) {
+		__whl_slice_set_state(slice, WHL_SLICE_RETURNED, memory_order_relaxed);
+		return 0;
+	}
+
+	view->head += __whl_split_span(split, slice);
+
+	return 1 + __whl_split_reclaim(split, view);
+}
+
+void
+__whl_split_return_through(whl_split_t *split, whl_split_view_t *view,
+                           whl_offset_t offset)
+{
+	/* how far this slice is after the head, in the same lap */
+	u64 ahead = (((u64)offset << split->align_shift) + split->size
+	             - view->head % split->size) % split->size;
+
+	view->head += ahead + __whl_split_span(split, __whl_split_slice(split, offset));
+
+	__whl_split_reclaim(split, view);
+}
+
+void
+__whl_split_iter_shared_slices(whl_split_t *split, whl_split_view_t *view,
+                               whl_split_iter_t *iter)
+{
+	view->tail = atomic_load_explicit(&split->tail, memory_order_acquire);
+	*iter = (whl_split_iter_t) { .pos = view->head, .tail = view->tail };
+}
+
+whl_offset_t
+__whl_split_iter_next(whl_split_t *split, whl_split_iter_t *iter,
+                      byte **bufp, size_t *size)
+{
+	whl_slice_t *slice;
+	size_t       user_size;
+	u8           state;
+
+	while (iter->pos != iter->tail) {
+
+		slice = __whl_split_at(split, iter->pos);
+		state = __whl_slice_load(slice, &user_size, memory_order_acquire);
+
+		/* step over padding and slices returned out of order */
+		if (state == WHL_SLICE_PADDING || state == WHL_SLICE_RETURNED) {
+			iter->pos += __whl_split_span(split, slice);
+			continue;
+		}
+
+		if (state != WHL_SLICE_READABLE)
+			break;
+
+		whl_offset_t offset = (iter->pos % split->size) >> split->align_shift;
+
+		*bufp = __whl_slice_buf(slice);
+		*size = user_size;
+		iter->pos += __whl_split_span(split, slice);
+		return offset;
+	}
+
+	return WHL_INVALID_OFFSET;
+}
+
+/* positions only increase, so carrying on just needs the new tail */
+void
+__whl_split_iter_more(whl_split_t *split, whl_split_iter_t *iter)
+{
+	iter->tail = atomic_load_explicit(&split->tail, memory_order_acquire);
+}
+
+/* `whl_split_t` version of `whl_make_slice`
+ *
+ * on success, copies the buf pointer to *bufp and returns an offset
+ *
+ * if there isn't room for a slice of this size,
+ * returns WHL_INVALID_OFFSET and *bufp is untouched */
+whl_offset_t
+whl_producer_make_slice(whl_producer_t *producer, byte **bufp, size_t size)
+{
+	return __whl_split_make_slice(producer->split, &producer->view,
+	                              bufp, size);
+}
+
+/* `whl_split_t` version of `whl_share_slice`
+ *
+ * slices can be shared in a different order than they were made, the consumer
+ * still gets them in the order they were made. */
+void
+whl_producer_share_slice(whl_producer_t *producer, whl_offset_t offset)
+{
+	__whl_split_share_slice(producer->split, &producer->view, offset);
+}
+
+/* `whl_split_t` version of `whl_make_slices` */
+size_t
+whl_producer_make_slices(whl_producer_t *producer, whl_offset_t *offsets,
+                         byte **bufps, const size_t *sizes, size_t n)
+{
+	return __whl_split_make_slices(producer->split, &producer->view,
+	                               offsets, bufps, sizes, n);
+}
+
+/* `whl_split_t` version of `whl_share_slices`
+ *
+ * updates the shared tail once for all the slices */
+void
+whl_producer_share_slices(whl_producer_t *producer,
+                          const whl_offset_t *offsets, size_t n)
+{
+	__whl_split_share_slices(producer->split, &producer->view, offsets, n);
+}
+
+/* `whl_split_t` version of `whl_commit_slice` */
+int
+whl_producer_commit_slice(whl_producer_t *producer, whl_offset_t offset,
+                          size_t size)
+{
+	return __whl_split_commit_slice(producer->split, &producer->view,
+	                                offset, size);
+}
+
+/* `whl_split_t` version of `whl_abort_slice`
+ *
+ * all the slice's room goes back to the next slice made */
+int
+whl_producer_abort_slice(whl_producer_t *producer, whl_offset_t offset)
+{
+	return __whl_split_abort_slice(producer->split, &producer->view, offset);
+}
+
+/* `whl_split_t` version of `whl_grow_slice` */
+int
+whl_producer_grow_slice(whl_producer_t *producer, whl_offset_t offset,
+                        size_t size)
+{
+	return __whl_split_grow_slice(producer->split, &producer->view,
+	                              offset, size);
+}
+
+/* `whl_split_t` version of `whl_next_shared_slice`
+ *
+ * this does not advance the read head, calling this again will return the same
+ * slice, return the previous slice before calling this again.
+ *
+ * only modifies bufp and size on success
+ * returns WHL_INVALID_OFFSET if the next slice is not shared */
+whl_offset_t
+whl_consumer_next_shared_slice(whl_consumer_t *consumer,
+                               byte **bufp, size_t *size)
+{
+	return __whl_split_next_shared_slice(consumer->split, &consumer->view,
+	                                     bufp, size);
+}
+
+/* `whl_split_t` version of `whl_return_slice`
+ *
+ * returning the slice at the head moves the head along without writing to the
+ * slice. returning a slice after the head only marks it returned, the head
+ * passes over it once the slices before it are returned.
+ *
+ * returns the number of slices the head moved over */
+size_t
+whl_consumer_return_slice(whl_consumer_t *consumer, whl_offset_t offset)
+{
+	return __whl_split_return_slice(consumer->split, &consumer->view, offset);
+}
+
+/* `whl_split_t` version of `whl_iter_shared_slices` */
+void
+whl_consumer_iter_shared_slices(whl_consumer_t *consumer,
+                                whl_split_iter_t *iter)
+{
+	__whl_split_iter_shared_slices(consumer->split, &consumer->view, iter);
+}
+
+/* `whl_split_t` version of `whl_iter_next` */
+whl_offset_t
+whl_consumer_iter_next(whl_consumer_t *consumer, whl_split_iter_t *iter,
+                       byte **bufp, size_t *size)
+{
+	return __whl_split_iter_next(consumer->split, iter, bufp, size);
+}
+
+/* `whl_split_t` version of `whl_iter_more` */
+void
+whl_consumer_iter_more(whl_consumer_t *consumer, whl_split_iter_t *iter)
+{
+	__whl_split_iter_more(consumer->split, iter);
+}
+
+/* `whl_split_t` version of `whl_return_through`
+ *
+ * stores the shared head once */
+void
+whl_consumer_return_through(whl_consumer_t *consumer, whl_offset_t offset)
+{
+	__whl_split_return_through(consumer->split, &consumer->view, offset);
+}
 
-#define __whl_affirm(c)   while (!(c)) __builtin_unreachable()
-#define __whl_staticassert(desc, test) \
-	const char __static_assert ## desc [(test) ? 0 : -1]
+#ifdef WHL_SPLIT
 
-typedef enum {
-	WHL_SLICE_UNINIT   = 0x0,
-	WHL_SLICE_READABLE = 0x1,
-	WHL_SLICE_RETURNED = 0x2,
-} whl_slice_state_e;
+/* with WHL_SPLIT, `whl_t` is a `whl_split_t` and these use the copy of each
+ * end's view on that end's line of the wheel. see `whl_split_init()` for
+ * arguments. */
+int
+whl_init(whl_t *wheel, size_t buf_size)
+{
+	return whl_split_init(wheel, buf_size);
+}
 
-typedef struct whl_slice {
-	/* the size in bytes the user requested, at least this many bytes is
-	 * reserved for this slice in the memory immediately following the slice's
-	 * header */
-	size_t               user_size;
-	/* WHL_ALIGN * aligned_size_in_wheel >= user_size */
-	_Atomic whl_offset_t aligned_size_in_wheel;
-	_Atomic u8           state;
-} whl_slice_t;
+int
+whl_init_aligned(whl_t *wheel, size_t buf_size, size_t align)
+{
+	return whl_split_init_aligned(wheel, buf_size, align);
+}
 
-typedef union {
-	struct {
-		whl_offset_t head;
-		whl_offset_t last;
-	};
-	uint64_t u64;
-} whl_offset_pair_t;
+int
+whl_init_mirrored(whl_t *wheel, size_t buf_size, size_t align)
+{
+	return whl_split_init_mirrored(wheel, buf_size, align);
+}
 
-typedef union {
-	struct {
-		u8 u8a;
-		u8 u8b;
-	};
-	u16 u16;
-} whl_u8_pair_t;
+whl_offset_t
+whl_make_slice(whl_t *wheel, byte **bufp, size_t size)
+{
+	return __whl_split_make_slice(wheel, &wheel->producer, bufp, size);
+}
 
-const whl_offset_pair_t whl_invalid_offset_pair =
-	{ .u64 = WHL_INVALID_OFFSET_PAIR };
+void
+whl_share_slice(whl_t *wheel, whl_offset_t offset)
+{
+	__whl_split_share_slice(wheel, &wheel->producer, offset);
+}
 
-/* lives in shared memory */
-typedef struct {
-	/* the size of the usable buffer in memory following */
-	whl_offset_t aligned_size;
-	union {
-		struct {
-			/* head is the oldest slice that is "allocated" and not returned,
-			 * or WHL_INVALID_OFFSET if no such slice */
-			_Atomic whl_offset_t head;
-			/* last is the most recent slice "allocated" and not returned,
-			 * or WHL_INVALID_OFFSET if no such slice */
-			_Atomic whl_offset_t last;
-		};
-		_Atomic whl_offset_pair_t head_last;
-	};
-} whl_spin_t;
+size_t
+whl_make_slices(whl_t *wheel, whl_offset_t *offsets, byte **bufps,
+                const size_t *sizes, size_t n)
+{
+	return __whl_split_make_slices(wheel, &wheel->producer,
+	                               offsets, bufps, sizes, n);
+}
 
-/* lives in shared memory */
-typedef struct {
-	whl_spin_t spin;
-	union {
-		struct {
-			_Atomic u8 readable_guard;
-			/* initially 0. set to 1 when a slice is shared. */
-			_Atomic u8 is_readable;
-		};
-		_Atomic whl_u8_pair_t readable_state;
-	};
-	union {
-		struct {
-			_Atomic u8 writable_guard;
-			/* initially 1. set to 0 when making a slice fails. */
-			_Atomic u8 is_writable;
-		};
-		_Atomic whl_u8_pair_t writable_state;
-	};
-} whl_atomic_t;
+void
+whl_share_slices(whl_t *wheel, const whl_offset_t *offsets, size_t n)
+{
+	__whl_split_share_slices(wheel, &wheel->producer, offsets, n);
+}
 
+int
+whl_commit_slice(whl_t *wheel, whl_offset_t offset, size_t size)
+{
+	return __whl_split_commit_slice(wheel, &wheel->producer, offset, size);
+}
 
-/* I don't know if this is really important */
-__whl_staticassert(whl_slice_t_sizeof, sizeof(whl_slice_t) == 16);
-/* whl_spin_t and whl_atomic_t do need to be <= WHL_ALIGN because
- * of whl_init only reserves WHL_ALIGN room for the wheel header.
- * it would almost be fine to accept a variable size and pad it
- * but __whl_buf() would have to change */
-__whl_staticassert(whl_spin_t_sizeof, sizeof(whl_spin_t) <= WHL_ALIGN);
-__whl_staticassert(whl_aotmic_t_sizeof, sizeof(whl_atomic_t) <= WHL_ALIGN);
+int
+whl_abort_slice(whl_t *wheel, whl_offset_t offset)
+{
+	return __whl_split_abort_slice(wheel, &wheel->producer, offset);
+}
 
-/* a copy for each process with different file descriptor table or virtual
- * address space */
-typedef struct {
-	whl_atomic_t *atomic;
-	/* a file descriptor that polls readable when at least one message is
-	 * shared and not yet taken */
-	int           readable;
-	/* a file descriptor that polls writable when there might be room for
-	 * message */
-	int           writable;
-} whl_efd_t;
+int
+whl_grow_slice(whl_t *wheel, whl_offset_t offset, size_t size)
+{
+	return __whl_split_grow_slice(wheel, &wheel->producer, offset, size);
+}
 
-typedef whl_spin_t whl_t;
+whl_offset_t
+whl_next_shared_slice(whl_t *wheel, byte **bufp, size_t *size)
+{
+	return __whl_split_next_shared_slice(wheel, &wheel->consumer, bufp, size);
+}
 
-#define __whl_buf(wheel)            ((byte *)(wheel) + WHL_ALIGN)
-#define __whl_slice_buf(slice)      ((byte *)(((whl_slice_t *)(slice)) + 1))
-#define __whl_alignment_padding(sz) ((WHL_ALIGN - ((sz) % WHL_ALIGN)) % WHL_ALIGN)
-#define __whl_aligned(sz)           ((sz) + __whl_alignment_padding(sz))
+size_t
+whl_return_slice(whl_t *wheel, whl_offset_t offset)
+{
+	return __whl_split_return_slice(wheel, &wheel->consumer, offset);
+}
+
+void
+whl_iter_shared_slices(whl_t *wheel, whl_iter_t *iter)
+{
+	__whl_split_iter_shared_slices(wheel, &wheel->consumer, iter);
+}
+
+whl_offset_t
+whl_iter_next(whl_t *wheel, whl_iter_t *iter, byte **bufp, size_t *size)
+{
+	return __whl_split_iter_next(wheel, iter, bufp, size);
+}
+
+void
+whl_iter_more(whl_t *wheel, whl_iter_t *iter)
+{
+	__whl_split_iter_more(wheel, iter);
+}
+
+void
+whl_return_through(whl_t *wheel, whl_offset_t offset)
+{
+	__whl_split_return_through(wheel, &wheel->consumer, offset);
+}
+
+#endif // WHL_SPLIT
 
+#ifndef WHL_SPLIT
+
+/* initializes the header for a buffer of `buf_size` bytes starting `buf_offset`
+ * bytes after `wheel` */
 int
-__whl_efd_write(int efd, uint64_t v)
+__whl_init(whl_t *wheel, size_t buf_offset, size_t buf_size, size_t align,
+           u8 mirrored)
 {
-	ssize_t r;
-	do {
-		r = write(efd, &v, sizeof(v));
-	} while (r < 0 && errno == EINTR);
-	return r == sizeof(v);
+	int shift = __whl_align_shift(align);
+
+	if (   shift < 0
+	    || buf_size < align
+	    || buf_size % align != 0
+	    || buf_size >> shift > WHL_SPAN_MAX
+	    || !atomic_is_lock_free(&wheel->head_last))
+		return -1;
+
+	*wheel = (whl_t) {
+		.aligned_size = buf_size >> shift,
+		.align_shift = shift,
+		.mirrored = mirrored,
+		.buf_offset = buf_offset,
+#ifdef WHL_COMPACT_SLICE
+		.wrap = WHL_INVALID_OFFSET,
+#endif
+		.head = WHL_INVALID_OFFSET,
+		.last = WHL_INVALID_OFFSET,
+	};
+	return 0;
 }
 
+/* like `whl_init()` but slices are aligned to, and take up a multiple of,
+ * `align` bytes instead of WHL_ALIGN. `align` is a power of two from
+ * WHL_ALIGN_MIN to WHL_ALIGN_MAX. it's kept in the header so only the end
+ * that initializes the wheel picks it.
+ *
+ * `buf_size` must be a multiple of `align` and leave at least one `align`
+ * after the header, which is 64 bytes or `align` if that's bigger.
+ *
+ * Returns 0 on success, non-zero on error. */
 int
-__whl_efd_read(int efd)
+whl_init_aligned(whl_t *wheel, size_t buf_size, size_t align)
 {
-	uint64_t v;
-	ssize_t  r;
-	do {
-		r = read(efd, &v, sizeof(v));
-	} while (r < 0 && errno == EINTR);
-	return r == sizeof(v);
+	size_t header = __whl_header_size(align);
+
+	if (buf_size < header)
+		return -1;
+
+	return __whl_init(wheel, header, buf_size - header, align, 0);
+}
+
+/* like `whl_init_aligned()` for shared memory where the buffer is mapped twice
+ * in a row, so a slice can start near the end of the buffer and keep going
+ * into the second mapping. then nothing is wasted at the end of the buffer
+ * when the producer wraps around.
+ *
+ * `buf_size` is the size of the shared memory, a multiple of the page size.
+ * the header takes the first page and the buffer the rest, `wheel` must point
+ * to a mapping of all of it followed directly by a second mapping of the
+ * buffer, from one page into the shared memory to the end. both ends map it
+ * this way. see `open_mirror_shm()` in example.c.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_init_mirrored(whl_t *wheel, size_t buf_size, size_t align)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	if (buf_size <= page || buf_size % page != 0 || align > page)
+		return -1;
+
+	return __whl_init(wheel, page, buf_size - page, align, 1);
 }
 
 /* `wheel` must point to allocated memory at least `size` big.
- * `buf_size` must be a multiple of 64, at least 128, less than 64 * u32 max.
+ * `buf_size` must be a multiple of 64, at least 128, less than 64 * u32 max
+ * unless WHL_OFFSET64 is defined.
  *
  * Returns 0 on success, non-zero on error.
  *
@@ -178,17 +1319,38 @@ __whl_efd_read(int efd)
 int
 whl_init(whl_t *wheel, size_t buf_size)
 {
-	if (   buf_size < 2 * WHL_ALIGN
-	    || buf_size % WHL_ALIGN != 0
-	    || buf_size >= WHL_ALIGN * UINT32_MAX)
-		return -1;
+	return whl_init_aligned(wheel, buf_size, WHL_ALIGN);
+}
 
-	*wheel = (whl_t) {
-		.aligned_size = (buf_size - WHL_ALIGN) / WHL_ALIGN,
-		.head = WHL_INVALID_OFFSET,
-		.last = WHL_INVALID_OFFSET,
+#endif // WHL_SPLIT
+
+/* the eventfd states a new `whl_atomic_t` starts with, before its wheel is
+ * initialized */
+void
+__whl_atomic_init_states(whl_atomic_t *wheel)
+{
+	*wheel = (whl_atomic_t) {
+		.is_readable = 0,
+		.is_writable = 1,
+		/* see whl_efd_make_slice() */
+		.writable_guard = (u8)~0,
 	};
-	return 0;
+}
+
+/* `whl_atomic_init()` with the slice alignment from `whl_init_aligned()` */
+int
+whl_atomic_init_aligned(whl_atomic_t *wheel, size_t buf_size, size_t align)
+{
+	__whl_atomic_init_states(wheel);
+	return whl_init_aligned(&wheel->spin, buf_size, align);
+}
+
+/* `whl_atomic_init()` for shared memory mapped like `whl_init_mirrored()` */
+int
+whl_atomic_init_mirrored(whl_atomic_t *wheel, size_t buf_size, size_t align)
+{
+	__whl_atomic_init_states(wheel);
+	return whl_init_mirrored(&wheel->spin, buf_size, align);
 }
 
 /* See whl_init for arguments.
@@ -214,12 +1376,7 @@ whl_init(whl_t *wheel, size_t buf_size)
 int
 whl_atomic_init(whl_atomic_t *wheel, size_t buf_size)
 {
-	*wheel = (whl_atomic_t) {
-		.is_readable = 0,
-		.is_writable = 1,
-		.writable_guard = WHL_INVALID_OFFSET,
-	};
-	return whl_init(&wheel->spin, buf_size);
+	return whl_atomic_init_aligned(wheel, buf_size, WHL_ALIGN);
 }
 
 /* Initializes `whl_efd_t` using the given already initialized `whl_atomic_t`
@@ -237,21 +1394,11 @@ whl_efd_init_from_eventfds(whl_efd_t *wheel,
 	};
 }
 
-/* Initializes `whl_efd_t` using the given already initialized `whl_atomic_t`.
- *
- * Creates eventfds for polling with an event loop. These file descriptors
- * should be duplicated (via scm_rights or something) to any process that might
- * use the same memory wheel from a different file descriptor mapping.
- *
- * Use `whl_efd_init_from_eventfds` to Initializes `whl_efd_t` from existing
- * file descriptors.
- *
- * eventfds are created with EFD_NONBLOCK | EFD_CLOEXEC
- *
- * Returns 0 on success, non-zero on error.
- * errno is probably set from the underlying failed eventfd call. */
+/* creates the eventfds for `whl_efd_init()`, readable and writable when polled
+ * if `is_readable` and `is_writable`. with `writablep` NULL it only makes the
+ * readable one, for ends that never wait to write */
 int
-whl_efd_init(whl_efd_t *wheel, whl_atomic_t *atomic)
+__whl_efd_open(u8 is_readable, u8 is_writable, int *readablep, int *writablep)
 {
 	/* Reasoning for EFD_SEMAPHORE
 	 *
@@ -280,10 +1427,15 @@ whl_efd_init(whl_efd_t *wheel, whl_atomic_t *atomic)
 	int readable;
 	int writable;
 
-	if ((readable = eventfd(atomic->is_readable, flags)) < 0) {
+	if ((readable = eventfd(is_readable, flags)) < 0) {
 		return -1;
 	}
 
+	if (writablep == NULL) {
+		*readablep = readable;
+		return 0;
+	}
+
 	if ((writable = eventfd(0, flags)) < 0) {
 		int no_clobber = errno;
 		close(readable);
@@ -295,7 +1447,7 @@ whl_efd_init(whl_efd_t *wheel, whl_atomic_t *atomic)
 	 * internally it uses a 64-bit value, the parameter to eventfd is like
 	 * 32-bits or something; very epic */
 
-	if (__whl_efd_write(writable, ~0lu - 1lu - atomic->is_writable) < 0) {
+	if (__whl_efd_write(writable, ~0lu - 1lu - is_writable) < 0) {
 		int no_clobber = errno;
 		close(writable);
 		close(readable);
@@ -303,6 +1455,34 @@ whl_efd_init(whl_efd_t *wheel, whl_atomic_t *atomic)
 		return -1;
 	}
 
+	*readablep = readable;
+	*writablep = writable;
+	return 0;
+}
+
+/* Initializes `whl_efd_t` using the given already initialized `whl_atomic_t`.
+ *
+ * Creates eventfds for polling with an event loop. These file descriptors
+ * should be duplicated (via scm_rights or something) to any process that might
+ * use the same memory wheel from a different file descriptor mapping.
+ *
+ * Use `whl_efd_init_from_eventfds` to Initializes `whl_efd_t` from existing
+ * file descriptors.
+ *
+ * eventfds are created with EFD_NONBLOCK | EFD_CLOEXEC
+ *
+ * Returns 0 on success, non-zero on error.
+ * errno is probably set from the underlying failed eventfd call. */
+int
+whl_efd_init(whl_efd_t *wheel, whl_atomic_t *atomic)
+{
+	int readable;
+	int writable;
+
+	if (__whl_efd_open(atomic->is_readable, atomic->is_writable,
+	                   &readable, &writable) < 0)
+		return -1;
+
 	whl_efd_init_from_eventfds(wheel, atomic, readable, writable);
 	return 0;
 }
@@ -329,10 +1509,12 @@ whl_efd_fds(whl_efd_t *wheel, int *readable, int *writable)
 	*writable = wheel->writable;
 }
 
+#ifndef WHL_SPLIT
+
 whl_slice_t *
 __whl_at_unchecked(whl_t *wheel, whl_offset_t offset)
 {
-	return (whl_slice_t *)(__whl_buf(wheel) + WHL_ALIGN * offset);
+	return (whl_slice_t *)(__whl_buf(wheel) + ((u64)offset << wheel->align_shift));
 }
 
 whl_slice_t *
@@ -355,6 +1537,19 @@ __whl_last(whl_t *wheel)
 		return __whl_at_unchecked(wheel, o);
 }
 
+/* the offset of the slice made after the one at `offset`, for the consumer.
+ * only call this if a slice was made after it, so the size is final */
+whl_offset_t
+__whl_after(whl_t *wheel, whl_offset_t offset)
+{
+	whl_offset_t next = offset + __whl_slice_span(__whl_at_unchecked(wheel, offset));
+#ifdef WHL_COMPACT_SLICE
+	if (next == atomic_load(&wheel->wrap))
+		return 0;
+#endif
+	return next % wheel->aligned_size;
+}
+
 whl_offset_t
 __whl_next_offset_aligned(whl_t *wheel, whl_offset_t size,
                           whl_offset_pair_t pair)
@@ -366,7 +1561,7 @@ __whl_next_offset_aligned(whl_t *wheel, whl_offset_t size,
 	 * - if head > last, we're wrapped around, head could advance or
 	 *   wrap around and follow behaviour as above */
 
-	if (pair.u64 == WHL_INVALID_OFFSET_PAIR) {
+	if (pair.word == WHL_INVALID_OFFSET_PAIR) {
 
 		if (size <= wheel->aligned_size)
 			return 0;
@@ -375,12 +1570,24 @@ __whl_next_offset_aligned(whl_t *wheel, whl_offset_t size,
 		whl_offset_t head = pair.head;
 		whl_offset_t last = pair.last;
 		whl_offset_t last_end =
-			last + __whl_at_unchecked(wheel, last)->aligned_size_in_wheel;
+			last + __whl_slice_span(__whl_at_unchecked(wheel, last));
 
 		__whl_affirm(head != WHL_INVALID_OFFSET);
 		__whl_affirm(last != WHL_INVALID_OFFSET);
 
-		if (last < head) {
+		if (wheel->mirrored) {
+
+			/* slices can run past the end into the second mapping, so
+			 * there's just the room from the end of the last slice around
+			 * to the head. if they're the same, the wheel is full */
+			whl_offset_t end = last_end % wheel->aligned_size;
+			whl_offset_t used = (end + wheel->aligned_size - head)
+			                  % wheel->aligned_size;
+
+			if (used && size <= wheel->aligned_size - used)
+				return end;
+
+		} else if (last < head) {
 
 			/* We've wrapped around, so we can only use area from the end of
 			 * the last slice up to the start of the first */
@@ -393,8 +1600,8 @@ __whl_next_offset_aligned(whl_t *wheel, whl_offset_t size,
 			if (size <= wheel->aligned_size - last_end)
 				return last_end;
 
-			/* Or maybe wrap around from the wheel start until the head */
-			/* TODO, if we do this, we have to backfill FIXME */
+			/* Or maybe wrap around from the wheel start until the head,
+			 * see `__whl_place_slice` */
 			if (size <= head)
 				return 0;
 
@@ -405,27 +1612,44 @@ __whl_next_offset_aligned(whl_t *wheel, whl_offset_t size,
 	return WHL_INVALID_OFFSET;
 }
 
-/* on success, copies the buf pointer to *bufp and returns an offset
+/* finds room for a slice of this size after the slices in `pair`, writes the
+ * slice's header there and moves pair->last to it
+ *
+ * this does not update head_last, so nothing outside this process knows about
+ * the slice until `__whl_publish_slices`
  *
  * if there isn't room for a slice of this size,
- * returns WHL_INVALID_OFFSET and *bufp is untouched */
+ * returns WHL_INVALID_OFFSET and *pair and *bufp are untouched */
 whl_offset_t
-whl_make_slice(whl_t *wheel, byte **bufp, size_t size)
+__whl_place_slice(whl_t *wheel, whl_offset_pair_t *pair,
+                  byte **bufp, size_t size)
 {
-	size_t       size_in_wheel = __whl_aligned(sizeof(whl_slice_t) + size);
-	whl_offset_t aligned_size_in_wheel = size_in_wheel / WHL_ALIGN;
+	size_t       size_in_wheel = __whl_aligned(wheel, sizeof(whl_slice_t) + size);
+	whl_offset_t aligned_size_in_wheel = size_in_wheel >> wheel->align_shift;
 
-	if (aligned_size_in_wheel > wheel->aligned_size)
+	if (   size_in_wheel >> wheel->align_shift > wheel->aligned_size
+	    || size > WHL_SLICE_SIZE_MAX)
 		return WHL_INVALID_OFFSET;
 
-	whl_offset_pair_t pair = atomic_load(&wheel->head_last);
-	whl_offset_t      offset = __whl_next_offset_aligned(wheel, aligned_size_in_wheel, pair);
+	whl_offset_t offset = __whl_next_offset_aligned(wheel, aligned_size_in_wheel, *pair);
 
 	if (offset == WHL_INVALID_OFFSET)
 		return WHL_INVALID_OFFSET;
 
-	whl_offset_t old_last = pair.last;
+	whl_offset_t old_last = pair->last;
 
+#ifdef WHL_COMPACT_SLICE
+	/* instead of backfilling, say where the consumer wraps around. the
+	 * consumer is past any earlier wrap since we're not wrapped around now.
+	 *
+	 * a slice made where the last wrap was means the consumer is past that
+	 * too, and a slice might end there next time without wrapping */
+	if (offset == 0 && old_last != WHL_INVALID_OFFSET && !wheel->mirrored)
+		atomic_store(&wheel->wrap,
+		             old_last + __whl_slice_span(__whl_at_unchecked(wheel, old_last)));
+	else if (offset == atomic_load_explicit(&wheel->wrap, memory_order_relaxed))
+		atomic_store(&wheel->wrap, WHL_INVALID_OFFSET);
+#else
 	/* backfill,
 	 * there cannot be a void after the (old) last slice,
 	 * else we can't return it
@@ -433,38 +1657,51 @@ whl_make_slice(whl_t *wheel, byte **bufp, size_t size)
 	 * =( ------[slice]------|
 	 * =D ------[slice~~~~~~]|
 	 *
-	 * FIXME we can probably shrink the slice struct if we smuggle this into
-	 * the wheel struct instead */
-	if (offset == 0 && (old_last != WHL_INVALID_OFFSET))
+	 * WHL_COMPACT_SLICE smuggles this into the wheel struct instead */
+	if (offset == 0 && old_last != WHL_INVALID_OFFSET && !wheel->mirrored)
 		atomic_store(&__whl_at_unchecked(wheel, old_last)->aligned_size_in_wheel,
 		             wheel->aligned_size - old_last);
+#endif
 
-	*__whl_at_unchecked(wheel, offset) = (whl_slice_t) {
-		.user_size = size,
-		.aligned_size_in_wheel = aligned_size_in_wheel,
-	};
+	__whl_slice_store(__whl_at_unchecked(wheel, offset),
+	                  size, aligned_size_in_wheel, WHL_SLICE_UNINIT,
+	                  memory_order_relaxed);
 
 	*bufp = __whl_slice_buf(__whl_at_unchecked(wheel, offset));
 
+	if (pair->word == WHL_INVALID_OFFSET_PAIR)
+		*pair = (whl_offset_pair_t) { .head = offset, .last = offset };
+	else
+		pair->last = offset;
+
+	return offset;
+}
+
+/* updates head_last for the slices from `first` to `last` placed by
+ * `__whl_place_slice` since head_last was loaded into `pair` */
+void
+__whl_publish_slices(whl_t *wheel, whl_offset_pair_t pair,
+                     whl_offset_t first, whl_offset_t last)
+{
 	/* below is basically just an atomic version of
 	 *
-	 * wheel->last = offset;
+	 * wheel->last = last;
 	 * if (wheel->head == WHL_INVALID_OFFSET)
-	 *     wheel->head = offset; */
+	 *     wheel->head = first; */
 	do {
 		/* invariant:
 		 * head and last must always be either both valid or both invalid */
-		if (pair.u64 == WHL_INVALID_OFFSET_PAIR) {
+		if (pair.word == WHL_INVALID_OFFSET_PAIR) {
 			/* if head was invalid, it will remain invalid
 			 * because this is single-producer single-consumer and the consumer
 			 * does not move head off from the invalid offset */
-			pair = (whl_offset_pair_t) { .head = offset, .last = offset };
+			pair = (whl_offset_pair_t) { .head = first, .last = last };
 			atomic_store(&wheel->head_last, pair);
 			break;
 		} else {
 			/* head was not invalid, it _could_ have become so since we last
 			 * saw it, so compare and exchange to keep the invariant */
-			whl_offset_pair_t new_pair = { .head = pair.head, .last = offset };
+			whl_offset_pair_t new_pair = { .head = pair.head, .last = last };
 			if (atomic_compare_exchange_strong(&wheel->head_last,
 			                                   /* expected */
 			                                   &pair,
@@ -474,10 +1711,105 @@ whl_make_slice(whl_t *wheel, byte **bufp, size_t size)
 		}
 		pair = atomic_load(&wheel->head_last);
 	} while (1);
+}
+
+/* on success, copies the buf pointer to *bufp and returns an offset
+ *
+ * if there isn't room for a slice of this size,
+ * returns WHL_INVALID_OFFSET and *bufp is untouched */
+whl_offset_t
+whl_make_slice(whl_t *wheel, byte **bufp, size_t size)
+{
+	whl_offset_pair_t pair = atomic_load(&wheel->head_last);
+	whl_offset_pair_t placed = pair;
+	whl_offset_t      offset = __whl_place_slice(wheel, &placed, bufp, size);
+
+	if (offset == WHL_INVALID_OFFSET)
+		return WHL_INVALID_OFFSET;
+
+	__whl_publish_slices(wheel, pair, offset, offset);
 
 	return offset;
 }
 
+/* makes up to `n` slices, the i-th sized `sizes[i]`, in one go
+ *
+ * this is like calling `whl_make_slice` for each size, stopping at the first
+ * that doesn't fit. but head_last is only loaded and updated once for all of
+ * them instead of once each.
+ *
+ * on success, copies each slice's offset and buf pointer to `offsets` and
+ * `bufps` in the order they were made
+ *
+ * returns the number of slices made, which is less than `n` if the rest didn't
+ * fit */
+size_t
+whl_make_slices(whl_t *wheel, whl_offset_t *offsets, byte **bufps,
+                const size_t *sizes, size_t n)
+{
+	whl_offset_pair_t pair = atomic_load(&wheel->head_last);
+	whl_offset_pair_t placed = pair;
+	size_t            made = 0;
+
+	while (   made < n
+	       && (offsets[made] = __whl_place_slice(wheel, &placed,
+	                                             &bufps[made], sizes[made]))
+	          != WHL_INVALID_OFFSET)
+		made++;
+
+	if (made)
+		__whl_publish_slices(wheel, pair, offsets[0], offsets[made - 1]);
+
+	return made;
+}
+
+#endif // WHL_SPLIT
+
+/* after making a slice fails, make `writable` unwritable when polled,
+ * see `whl_efd_make_slice` */
+void
+__whl_efd_unwritable(_Atomic whl_u8_pair_t *state, int efd)
+{
+	whl_u8_pair_t expect = { .u8a = ~0, .u8b = 1 };
+	whl_u8_pair_t desire = { .u8a = ~0, .u8b = 0 };
+	if (atomic_compare_exchange_strong(state, &expect, desire))
+		/* writing to the writable eventfd sets it to the maximum value,
+		 * making it non-writable */
+		__whl_efd_write(efd, 1);
+}
+
+/* after returning slices, make `writable` writable when polled */
+void
+__whl_efd_writable(_Atomic whl_u8_pair_t *state, int efd)
+{
+	whl_u8_pair_t expect = { .u8a = 0, .u8b = 0 };
+	whl_u8_pair_t desire = { .u8a = 0, .u8b = 1 };
+	if (atomic_compare_exchange_strong(state, &expect, desire))
+		__whl_efd_read(efd);
+}
+
+/* after sharing slices, make `readable` readable when polled */
+void
+__whl_efd_readable(_Atomic whl_u8_pair_t *state, int efd)
+{
+	whl_u8_pair_t expect = { .u8a = 0, .u8b = 0 };
+	whl_u8_pair_t desire = { .u8a = 0, .u8b = 1 };
+	if (atomic_compare_exchange_strong(state, &expect, desire))
+		__whl_efd_write(efd, 1);
+}
+
+/* after finding nothing shared, make `readable` unreadable when polled */
+void
+__whl_efd_unreadable(_Atomic whl_u8_pair_t *state, int efd)
+{
+	whl_u8_pair_t expect = { .u8a = ~0, .u8b = 1 };
+	whl_u8_pair_t desire = { .u8a = ~0, .u8b = 0 };
+	if (atomic_compare_exchange_strong(state, &expect, desire))
+		/* reading from the readable eventfd moves it to zero, making it
+		 * non-readable until a write by whl_efd_share_slice */
+		__whl_efd_read(efd);
+}
+
 /* `whl_efd_t` version of `whl_make_slice`
  *
  * if this returns WHL_INVALID_OFFSET it will try to set
@@ -503,29 +1835,195 @@ whl_efd_make_slice(whl_efd_t *wheel, byte **bufp, size_t size)
 	/* clear errno, it may be set by __whl_efd_write */
 	errno = 0;
 
-	if (offset == WHL_INVALID_OFFSET) {
-		whl_u8_pair_t expect = { .u8a = ~0, .u8b = 1 };
-		whl_u8_pair_t desire = { .u8a = ~0, .u8b = 0 };
-		if (atomic_compare_exchange_strong(&wheel->atomic->writable_state,
-		                                   &expect,
-		                                   desire))
-			/* writing to the writable eventfd sets it to the maximum value,
-			 * making it non-writable */
-			__whl_efd_write(wheel->writable, 1);
-	}
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unwritable(&wheel->atomic->writable_state,
+		                     wheel->writable);
 
 	return offset;
 }
 
+/* `whl_efd_t` version of `whl_make_slices`
+ *
+ * if this makes fewer than `n` slices it will try to set `whl_efd_t` `writable`
+ * to unwritable when polled, the same as when `whl_efd_make_slice` returns
+ * WHL_INVALID_OFFSET. if that fails, errno will be non-zero. */
+size_t
+whl_efd_make_slices(whl_efd_t *wheel, whl_offset_t *offsets, byte **bufps,
+                    const size_t *sizes, size_t n)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&wheel->atomic->writable_guard, ~0);
+
+	size_t made = whl_make_slices(&wheel->atomic->spin,
+	                              offsets, bufps, sizes, n);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	if (made < n)
+		__whl_efd_unwritable(&wheel->atomic->writable_state,
+		                     wheel->writable);
+
+	return made;
+}
+
+#ifndef WHL_SPLIT
+
 /* called after `whl_make_slice` to make a slice available to be returned by
  * `whl_next_shared_slice` by another process */
 void
 whl_share_slice(whl_t *wheel, whl_offset_t offset)
 {
-	atomic_store(&__whl_at_unchecked(wheel, offset)->state,
-	             WHL_SLICE_READABLE);
+	__whl_slice_set_state(__whl_at_unchecked(wheel, offset),
+	                      WHL_SLICE_READABLE, memory_order_seq_cst);
+}
+
+/* shares `n` slices from `whl_make_slices` at once, `offsets` must be in the
+ * order the slices were made and none of them shared yet
+ *
+ * the consumer can't get to a later slice before the first one, so only the
+ * first slice's state is stored with release, after the others. */
+void
+whl_share_slices(whl_t *wheel, const whl_offset_t *offsets, size_t n)
+{
+	if (!n)
+		return;
+
+	while (--n)
+		__whl_slice_set_state(__whl_at_unchecked(wheel, offsets[n]),
+		                      WHL_SLICE_READABLE, memory_order_relaxed);
+
+	__whl_slice_set_state(__whl_at_unchecked(wheel, offsets[0]),
+	                      WHL_SLICE_READABLE, memory_order_seq_cst);
+}
+
+/* the slice at `offset` if it's the most recently made and not shared yet,
+ * otherwise NULL */
+whl_slice_t *
+__whl_unshared_last(whl_t *wheel, whl_offset_t offset)
+{
+	whl_slice_t *slice;
+
+	if (atomic_load(&wheel->last) != offset)
+		return NULL;
+
+	slice = __whl_at_unchecked(wheel, offset);
+
+	if (__whl_slice_load(slice, NULL, memory_order_relaxed) != WHL_SLICE_UNINIT)
+		return NULL;
+
+	return slice;
+}
+
+/* called after `whl_make_slice` and before `whl_share_slice` to shrink the most
+ * recently made slice to `size`, in case it was made bigger than it turned out
+ * to need. the room after the new size can be used by the next slice made.
+ *
+ * returns 0 on success, or non-zero if the slice isn't the most recently made,
+ * is already shared, or is smaller than `size` */
+int
+whl_commit_slice(whl_t *wheel, whl_offset_t offset, size_t size)
+{
+	/* the consumer can't get to an unshared slice, and it's last so it can't
+	 * be backfilled by anyone but us. so no one else looks at its size */
+	whl_slice_t *slice = __whl_unshared_last(wheel, offset);
+	size_t       user_size;
+
+	if (!slice)
+		return -1;
+
+	__whl_slice_load(slice, &user_size, memory_order_relaxed);
+
+	if (size > user_size)
+		return -1;
+
+	__whl_slice_store(slice, size,
+	                  __whl_aligned(wheel, sizeof(whl_slice_t) + size)
+	                  >> wheel->align_shift,
+	                  WHL_SLICE_UNINIT, memory_order_seq_cst);
+	return 0;
+}
+
+/* called after `whl_make_slice` instead of `whl_share_slice` to give back the
+ * most recently made slice, the consumer never sees it.
+ *
+ * returns 0 on success, or non-zero if the slice isn't the most recently made
+ * or is already shared */
+int
+whl_abort_slice(whl_t *wheel, whl_offset_t offset)
+{
+	whl_slice_t      *slice = __whl_unshared_last(wheel, offset);
+	whl_offset_pair_t only = { .head = offset, .last = offset };
+
+	if (!slice)
+		return -1;
+
+	/* if it's the only slice, the wheel is just empty again */
+	if (atomic_compare_exchange_strong(&wheel->head_last,
+	                                   /* expected */
+	                                   &only,
+	                                   /* desired */
+	                                   whl_invalid_offset_pair))
+		return 0;
+
+	/* otherwise we can't move last back, the consumer may be moving head up
+	 * to it. so shrink it to just the header, so the next slice made goes
+	 * right after, and leave it returned for the consumer to step over */
+	__whl_slice_store(slice, 0,
+	                  __whl_aligned(wheel, sizeof(whl_slice_t)) >> wheel->align_shift,
+	                  WHL_SLICE_RETURNED, memory_order_seq_cst);
+	return 0;
+}
+
+/* called after `whl_make_slice` and before `whl_share_slice` to make the most
+ * recently made slice bigger without moving it, for writing something before
+ * knowing how big it is. the slice's buf pointer stays the same and what was
+ * written to it is kept.
+ *
+ * returns 0 on success, or non-zero if the slice isn't the most recently made,
+ * is already shared, is bigger than `size`, or there isn't room right after
+ * it. then share what's there and make another slice for the rest */
+int
+whl_grow_slice(whl_t *wheel, whl_offset_t offset, size_t size)
+{
+	whl_slice_t *slice = __whl_unshared_last(wheel, offset);
+	size_t       user_size;
+	size_t       aligned;
+	whl_offset_t head;
+
+	if (!slice || size > WHL_SLICE_SIZE_MAX)
+		return -1;
+
+	__whl_slice_load(slice, &user_size, memory_order_relaxed);
+
+	if (size < user_size)
+		return -1;
+
+	aligned = __whl_aligned(wheel, sizeof(whl_slice_t) + size) >> wheel->align_shift;
+
+	/* like `__whl_next_offset_aligned`, but we can't wrap around. and since
+	 * our slice isn't shared, head isn't WHL_INVALID_OFFSET and can't move
+	 * past us, it only makes more room if it moves */
+	head = atomic_load(&wheel->head);
+
+	if (wheel->mirrored) {
+		/* it can run past the end, up to the head. if we're the head,
+		 * everything else is returned and it can have the whole wheel */
+		whl_offset_t room = (head + wheel->aligned_size - offset)
+		                  % wheel->aligned_size;
+		if (aligned > (room ? room : wheel->aligned_size))
+			return -1;
+	} else if (head > offset ? aligned > head - offset
+	                         : aligned > wheel->aligned_size - offset)
+		return -1;
+
+	__whl_slice_store(slice, size, aligned, WHL_SLICE_UNINIT,
+	                  memory_order_seq_cst);
+	return 0;
 }
 
+#endif // WHL_SPLIT
+
 /* `whl_efd_t` version of `whl_share_slice`
  *
  * may try to set `whl_efd_t` `readable` to readable when polled.
@@ -540,12 +2038,64 @@ whl_efd_share_slice(whl_efd_t *wheel, whl_offset_t offset)
 	/* clear errno, it may be set by __whl_efd_write */
 	errno = 0;
 
-	whl_u8_pair_t expect = { .u8a = 0, .u8b = 0 };
-	whl_u8_pair_t desire = { .u8a = 0, .u8b = 1 };
-	if (atomic_compare_exchange_strong(&wheel->atomic->readable_state,
-	                                   &expect,
-	                                   desire))
-		__whl_efd_write(wheel->readable, 1);
+	__whl_efd_readable(&wheel->atomic->readable_state, wheel->readable);
+}
+
+/* `whl_efd_t` version of `whl_share_slices`
+ *
+ * writes to `whl_efd_t` `readable` at most once for all the slices.
+ * if that fails, errno will be non-zero. */
+void
+whl_efd_share_slices(whl_efd_t *wheel, const whl_offset_t *offsets, size_t n)
+{
+	atomic_store(&wheel->atomic->readable_guard, 0);
+
+	whl_share_slices(&wheel->atomic->spin, offsets, n);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	__whl_efd_readable(&wheel->atomic->readable_state, wheel->readable);
+}
+
+#ifndef WHL_SPLIT
+
+/* moves head over the returned slices at the head
+ *
+ * a few threads can do this at once, each step is a compare and exchange so
+ * head only moves over a slice once. if another thread moved it first, the
+ * slice we looked at may already be reused, so `desired` is thrown out when
+ * the exchange fails.
+ *
+ * returns the number of slices it moved over */
+size_t
+__whl_reclaim(whl_t *wheel)
+{
+	size_t             returns = 0;
+	whl_offset_pair_t  pair;
+	whl_offset_pair_t  desired;
+
+	while (   (pair = atomic_load(&wheel->head_last)).head != WHL_INVALID_OFFSET
+	       && (__whl_slice_load(__whl_at_unchecked(wheel, pair.head), NULL,
+	                            memory_order_seq_cst) == WHL_SLICE_RETURNED)) {
+
+		if (pair.head == pair.last)
+			desired = whl_invalid_offset_pair;
+		else
+			desired = (whl_offset_pair_t) {
+				.head = __whl_after(wheel, pair.head),
+				.last = pair.last,
+			};
+
+		if (atomic_compare_exchange_strong(&wheel->head_last,
+		                                   /* expected */
+		                                   &pair,
+		                                   /* desired */
+		                                   desired))
+			returns++;
+	}
+
+	return returns;
 }
 
 /* this does not advance the read head, calling this again will return the same
@@ -556,21 +2106,33 @@ whl_efd_share_slice(whl_efd_t *wheel, whl_offset_t offset)
 whl_offset_t
 whl_next_shared_slice(whl_t *wheel, byte **bufp, size_t *size)
 {
-	whl_offset_t offset = atomic_load(&wheel->head);
+	whl_offset_t offset;
+	whl_slice_t *slice;
+	size_t       user_size;
+	u8           state;
 
-	if (offset == WHL_INVALID_OFFSET)
-		return WHL_INVALID_OFFSET;
+	while ((offset = atomic_load(&wheel->head)) != WHL_INVALID_OFFSET) {
 
-	whl_slice_t *slice = __whl_at_unchecked(wheel, offset);
+		slice = __whl_at_unchecked(wheel, offset);
+		state = __whl_slice_load(slice, &user_size, memory_order_seq_cst);
 
-	if (atomic_load(&slice->state) != WHL_SLICE_READABLE)
-		return WHL_INVALID_OFFSET;
+		if (state == WHL_SLICE_READABLE) {
+			*bufp = __whl_slice_buf(slice);
+			*size = user_size;
+			return offset;
+		}
 
-	*bufp = __whl_slice_buf(slice);
-	*size = slice->user_size;
-	return offset;
+		/* the producer gave up on this slice with `whl_abort_slice`,
+		 * move the head over it and look again */
+		if (state != WHL_SLICE_RETURNED || !__whl_reclaim(wheel))
+			break;
+	}
+
+	return WHL_INVALID_OFFSET;
 }
 
+#endif // WHL_SPLIT
+
 /* `whl_efd_t` version of `whl_next_shared_slice`
  *
  * if this returns WHL_INVALID_OFFSET it will try to set
@@ -587,20 +2149,15 @@ whl_efd_next_shared_slice(whl_efd_t *wheel, byte **bufp, size_t *size)
 	/* clear errno, it may be set by __whl_efd_read */
 	errno = 0;
 
-	if (offset == WHL_INVALID_OFFSET) {
-		whl_u8_pair_t expect = { .u8a = ~0, .u8b = 1 };
-		whl_u8_pair_t desire = { .u8a = ~0, .u8b = 0 };
-		if (atomic_compare_exchange_strong(&wheel->atomic->readable_state,
-		                                   &expect,
-		                                   desire))
-			/* reading from the readable eventfd moves it to zero, making it
-			 * non-readable until a write by whl_efd_share_slice */
-			__whl_efd_read(wheel->readable);
-	}
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unreadable(&wheel->atomic->readable_state,
+		                     wheel->readable);
 
 	return offset;
 }
 
+#ifndef WHL_SPLIT
+
 /* after getting a slice from `whl_next_shared_slice`, this
  * "frees" it so that it can be re-used by `whl_make_slice` */
 size_t
@@ -610,44 +2167,131 @@ whl_return_slice(whl_t *wheel, whl_offset_t off)
 	 * - last can change
 	 * - head can change if it was WHL_INVALID_OFFSET */
 
-	size_t             returns = 0;
-	whl_slice_t       *slice = __whl_at_unchecked(wheel, off);
-	whl_offset_pair_t  pair;
+	whl_slice_t *slice = __whl_at_unchecked(wheel, off);
 
-	if (WHL_SLICE_RETURNED == atomic_exchange(&slice->state, WHL_SLICE_RETURNED))
+	if (WHL_SLICE_RETURNED == __whl_slice_exchange_state(slice, WHL_SLICE_RETURNED))
 		return 0;
 
-	/* this is supposed to handle returns in any order, like in case you pass
-	 * the offset from whl_make_slice in a different way than whl_share_slice
-	 * and whl_next_shared_slice, and then return the passed offsets in a
-	 * different order than they were given from whl_make_slice. mostly for
-	 * multi-producer multi-consumer.
-	 * but I don't think I ever tested it so idk lol =) */
+	/* slices can be returned in any order and from a few threads at once,
+	 * like workers in `memorywheel_pool.h`. the head only moves over slices
+	 * that are returned with nothing before them still out, so one that's
+	 * returned early waits for the ones before it and this returns 0 */
 
-	while (   (pair = atomic_load(&wheel->head_last)).head != WHL_INVALID_OFFSET
-	       && (atomic_load(&__whl_head(wheel)->state) == WHL_SLICE_RETURNED)) {
-
-		if (   pair.head == pair.last
-		    && atomic_compare_exchange_strong(&wheel->head_last,
-		                                      /* expected */
-		                                      &pair,
-		                                      /* desired */
-		                                      whl_invalid_offset_pair)) {
-			/* =) */
-		} else {
-			whl_slice_t *head = __whl_at_unchecked(wheel, pair.head);
-			whl_offset_t next_head
-				= (pair.head + atomic_load(&head->aligned_size_in_wheel))
-				% wheel->aligned_size;
-			atomic_store(&wheel->head, next_head);
-		}
+	return __whl_reclaim(wheel);
+}
+
+/* starts iterating over the slices shared so far, from the head
+ *
+ * `whl_iter_next` then gives each in the order they were made until one isn't
+ * shared. it only gives slices made before this was called, start over once
+ * they're returned to get slices made since.
+ *
+ * this doesn't change anything in the wheel */
+void
+whl_iter_shared_slices(whl_t *wheel, whl_iter_t *iter)
+{
+	whl_offset_pair_t pair = atomic_load(&wheel->head_last);
+	*iter = (whl_iter_t) { .offset = pair.head, .last = pair.last };
+}
+
+/* gives the next shared slice from the iteration started by
+ * `whl_iter_shared_slices`, like `whl_next_shared_slice` but without going to
+ * the wheel's head each time.
+ *
+ * only modifies bufp and size on success
+ * returns WHL_INVALID_OFFSET if the next slice is not shared or there are no
+ * more slices in this iteration */
+whl_offset_t
+whl_iter_next(whl_t *wheel, whl_iter_t *iter, byte **bufp, size_t *size)
+{
+	whl_offset_t offset;
+	whl_slice_t *slice;
+	size_t       user_size;
+	u8           state;
+
+	while ((offset = iter->offset) != WHL_INVALID_OFFSET) {
+
+		slice = __whl_at_unchecked(wheel, offset);
+		state = __whl_slice_load(slice, &user_size, memory_order_seq_cst);
+
+		/* step over slices that are returned already, either out of order or
+		 * by the producer with `whl_abort_slice` */
+		if (state != WHL_SLICE_READABLE && state != WHL_SLICE_RETURNED)
+			break;
+
+		/* slices before the last never change size again, last might still be
+		 * backfilled but we stop there */
+		iter->offset = offset == iter->last
+		             ? WHL_INVALID_OFFSET
+		             : __whl_after(wheel, offset);
 
-		returns++;
+		if (state == WHL_SLICE_READABLE) {
+			*bufp = __whl_slice_buf(slice);
+			*size = user_size;
+			return offset;
+		}
 	}
 
-	return returns;
+	return WHL_INVALID_OFFSET;
+}
+
+/* carries on an iteration from `whl_iter_shared_slices` with the slices shared
+ * since, from where it got to instead of from the head.
+ *
+ * only while a slice it gave isn't returned yet. otherwise everything it knows
+ * about may be returned and reused, so start over with
+ * `whl_iter_shared_slices` */
+void
+whl_iter_more(whl_t *wheel, whl_iter_t *iter)
+{
+	whl_offset_pair_t pair = atomic_load(&wheel->head_last);
+
+	if (pair.last == WHL_INVALID_OFFSET || pair.last == iter->last)
+		return;
+
+	/* it got past the old last, which isn't last anymore so its size is
+	 * final */
+	if (iter->offset == WHL_INVALID_OFFSET)
+		iter->offset = iter->last == WHL_INVALID_OFFSET
+		             ? pair.head
+		             : __whl_after(wheel, iter->last);
+
+	iter->last = pair.last;
+}
+
+/* returns every slice from the head up to and including the one at `offset`,
+ * like calling `whl_return_slice` on each in order but with one update of the
+ * head instead of one per slice. and it doesn't write to the slices.
+ *
+ * so don't also return any of them with `whl_return_slice` */
+void
+whl_return_through(whl_t *wheel, whl_offset_t offset)
+{
+	whl_offset_pair_t pair = atomic_load(&wheel->head_last);
+
+	do {
+		if (pair.last == offset) {
+			/* everything made is returned */
+			if (atomic_compare_exchange_strong(&wheel->head_last,
+			                                   /* expected */
+			                                   &pair,
+			                                   /* desired */
+			                                   whl_invalid_offset_pair))
+				return;
+			/* the producer made another since, now it's the other case */
+		} else {
+			/* last is after this slice so its size is final */
+			atomic_store(&wheel->head, __whl_after(wheel, offset));
+			break;
+		}
+	} while (1);
+
+	/* then anything after it returned out of order */
+	__whl_reclaim(wheel);
 }
 
+#endif // WHL_SPLIT
+
 /* `whl_efd_t` version of `whl_return_slice`
  *
  * may try to set `whl_efd_t` `writable` to writable when polled.
@@ -663,14 +2307,64 @@ whl_efd_return_slice(whl_efd_t *wheel, whl_offset_t offset)
 	/* clear errno, it may be set by __whl_efd_read */
 	errno = 0;
 
-	if (r > 0) {
-		whl_u8_pair_t expect = { .u8a = 0, .u8b = 0 };
-		whl_u8_pair_t desire = { .u8a = 0, .u8b = 1 };
-		if (atomic_compare_exchange_strong(&wheel->atomic->writable_state,
-		                                   &expect,
-		                                   desire))
-			__whl_efd_read(wheel->writable);
-	}
+	if (r > 0)
+		__whl_efd_writable(&wheel->atomic->writable_state,
+		                   wheel->writable);
 
 	return r;
 }
+
+/* `whl_efd_t` version of `whl_iter_shared_slices`
+ *
+ * use `whl_efd_iter_next` with this */
+void
+whl_efd_iter_shared_slices(whl_efd_t *wheel, whl_iter_t *iter)
+{
+	/* any slice shared after this is shared after the iteration started, so
+	 * it's safe for whl_efd_iter_next() to set readable to unreadable if that
+	 * hasn't happened */
+	atomic_store(&wheel->atomic->readable_guard, ~0);
+
+	whl_iter_shared_slices(&wheel->atomic->spin, iter);
+}
+
+/* `whl_efd_t` version of `whl_iter_next`
+ *
+ * if this returns WHL_INVALID_OFFSET it will try to set `whl_efd_t` `readable`
+ * to unreadable when polled, which only happens once per iteration.
+ * if that fails, errno will be non-zero. */
+whl_offset_t
+whl_efd_iter_next(whl_efd_t *wheel, whl_iter_t *iter,
+                  byte **bufp, size_t *size)
+{
+	whl_offset_t offset = whl_iter_next(&wheel->atomic->spin, iter,
+	                                    bufp, size);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unreadable(&wheel->atomic->readable_state,
+		                     wheel->readable);
+
+	return offset;
+}
+
+/* `whl_efd_t` version of `whl_return_through`
+ *
+ * may try to set `whl_efd_t` `writable` to writable when polled, once for all
+ * the slices returned. if that fails, errno will be non-zero. */
+void
+whl_efd_return_through(whl_efd_t *wheel, whl_offset_t offset)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&wheel->atomic->writable_guard, 0);
+
+	whl_return_through(&wheel->atomic->spin, offset);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	__whl_efd_writable(&wheel->atomic->writable_state, wheel->writable);
+}
+
@@ -0,0 +1,403 @@
+/* `whl_bcast_t` is for one producer sending the same feed to a few consumers,
+ * each written once into shared memory and read by all of them, instead of a
+ * wheel per consumer with a copy of every message in each.
+ *
+ * every consumer has its own position in the shared header, on its own line,
+ * and gets every message in order. the producer only takes back room once the
+ * slowest consumer is past it, it keeps the least of their positions and only
+ * looks at them all again when the ring looks full. a consumer that's going
+ * away for good calls `whl_bcast_leave()` so it stops holding the others up.
+ *
+ * messages are laid out like in `whl_split_t`, in order with positions that
+ * only increase, each 8 byte aligned with an 8 byte header. one that doesn't
+ * fit before the end of the ring goes at the start after a padding header.
+ * the number of consumers is fixed at `whl_bcast_init()` and each one is
+ * known by its index, they all start at the first message. include
+ * memorywheel.h before this.
+ *
+ * `whl_bcast_efd_t` polls like `whl_efd_t` with a readable eventfd for each
+ * consumer and one writable eventfd for the producer, see
+ * `whl_bcast_efd_init()`.
+ *
+ * writer:
+ * - `whl_bcast_make_slice()`
+ * - `whl_bcast_share_slice()`
+ *
+ * each reader:
+ * - `whl_bcast_next_shared_slice()`
+ * - `whl_bcast_return_slice()` */
+
+#define WHL_BCAST_CONSUMERS_MAX 16
+/* a line for the sizes, the producer, and the writable state, then a line for
+ * each consumer */
+#define WHL_BCAST_HEADER_SIZE   ((3 + WHL_BCAST_CONSUMERS_MAX) * WHL_CACHE_LINE)
+#define WHL_BCAST_ALIGN         8
+/* the low bit of a message's header, the size is shifted up over it */
+#define WHL_BCAST_PADDING       0x1
+
+/* a consumer's own line in the shared header */
+typedef struct {
+	/* written by the consumer, the position of the next message it reads or
+	 * WHL_INVALID_POS once it's left */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 head;
+	/* the consumer's, what it last loaded from tail */
+	u64         consumer_tail;
+	/* like in `whl_atomic_t`, written by the producer and this consumer */
+	union {
+		struct {
+			_Atomic u8 readable_guard;
+			/* initially 0. set to 1 when a message is shared. */
+			_Atomic u8 is_readable;
+		};
+		_Atomic whl_u8_pair_t readable_state;
+	};
+} whl_bcast_cursor_t;
+
+/* lives in shared memory, the ring follows it */
+typedef struct {
+	/* the size of the ring in bytes, a multiple of WHL_BCAST_ALIGN,
+	 * read-only after `whl_bcast_init()` */
+	u64                size;
+	/* read-only after `whl_bcast_init()` */
+	u64                consumers;
+	/* written by the producer, the position after the last shared */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64        tail;
+	/* the producer's, the position after the last made */
+	u64                reserved;
+	/* the producer's, the least consumer head it last looked at */
+	u64                producer_head;
+	/* like in `whl_atomic_t`, written by the producer and any consumer */
+	_Alignas(WHL_CACHE_LINE)
+	union {
+		struct {
+			_Atomic u8 writable_guard;
+			/* initially 1. set to 0 when making a message fails. */
+			_Atomic u8 is_writable;
+		};
+		_Atomic whl_u8_pair_t writable_state;
+	};
+	whl_bcast_cursor_t cursors[WHL_BCAST_CONSUMERS_MAX];
+} whl_bcast_t;
+
+__whl_staticassert(whl_bcast_cursor_t_sizeof, sizeof(whl_bcast_cursor_t) == WHL_CACHE_LINE);
+__whl_staticassert(whl_bcast_t_sizeof, sizeof(whl_bcast_t) <= WHL_BCAST_HEADER_SIZE);
+
+/* a copy for each process, like `whl_efd_t`. the producer's has every
+ * consumer's readable eventfd, a consumer's only has its own */
+typedef struct {
+	whl_bcast_t *bcast;
+	/* the consumer's index, or -1 for the producer */
+	int          consumer;
+	int          readable[WHL_BCAST_CONSUMERS_MAX];
+	int          writable;
+} whl_bcast_efd_t;
+
+#define __whl_bcast_at(bcast, pos) \
+	((u64 *)((byte *)(bcast) + WHL_BCAST_HEADER_SIZE + (pos) % (bcast)->size))
+#define __whl_bcast_span(size) \
+	(sizeof(u64) + (((u64)(size) + WHL_BCAST_ALIGN - 1) & ~(u64)(WHL_BCAST_ALIGN - 1)))
+
+/* `bcast` must point to allocated memory at least `buf_size` big, aligned to
+ * a cache line, for `consumers` consumers, at most WHL_BCAST_CONSUMERS_MAX.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_bcast_init(whl_bcast_t *bcast, size_t buf_size, size_t consumers)
+{
+	if (   consumers == 0
+	    || consumers > WHL_BCAST_CONSUMERS_MAX
+	    || buf_size < WHL_BCAST_HEADER_SIZE + 2 * WHL_BCAST_ALIGN
+	    || buf_size - WHL_BCAST_HEADER_SIZE > WHL_INVALID_OFFSET)
+		return -1;
+
+	*bcast = (whl_bcast_t) {
+		.size = (buf_size - WHL_BCAST_HEADER_SIZE) & ~(u64)(WHL_BCAST_ALIGN - 1),
+		.consumers = consumers,
+		.tail = 0,
+		.is_writable = 1,
+	};
+
+	for (size_t i = 0; i < WHL_BCAST_CONSUMERS_MAX; i++)
+		bcast->cursors[i] = (whl_bcast_cursor_t) {
+			.head = i < consumers ? 0 : WHL_INVALID_POS,
+			.is_readable = 0,
+		};
+
+	return 0;
+}
+
+/* the least head of the consumers that haven't left, or `reserved` if
+ * they all have */
+u64
+__whl_bcast_min_head(whl_bcast_t *bcast)
+{
+	u64 min = bcast->reserved;
+
+	for (u64 i = 0; i < bcast->consumers; i++) {
+		/* the acquire pairs with the consumer being done reading */
+		u64 head = atomic_load_explicit(&bcast->cursors[i].head,
+		                                memory_order_acquire);
+		if (head != WHL_INVALID_POS && head < min)
+			min = head;
+	}
+
+	return min;
+}
+
+/* like `whl_make_slice()`
+ *
+ * returns WHL_INVALID_OFFSET if there isn't room before the slowest consumer
+ * and *bufp is untouched */
+whl_offset_t
+whl_bcast_make_slice(whl_bcast_t *bcast, byte **bufp, size_t size)
+{
+	u64 span = __whl_bcast_span(size);
+	u64 pos = bcast->reserved;
+	u64 pad = 0;
+
+	if (span > bcast->size)
+		return WHL_INVALID_OFFSET;
+
+	if (span > bcast->size - pos % bcast->size)
+		pad = bcast->size - pos % bcast->size;
+
+	/* only look at every consumer's line if it looks like we're full */
+	if (pos + pad + span - bcast->producer_head > bcast->size) {
+		bcast->producer_head = __whl_bcast_min_head(bcast);
+		if (pos + pad + span - bcast->producer_head > bcast->size)
+			return WHL_INVALID_OFFSET;
+	}
+
+	if (pad) {
+		*__whl_bcast_at(bcast, pos) = pad << 1 | WHL_BCAST_PADDING;
+		pos += pad;
+	}
+
+	*__whl_bcast_at(bcast, pos) = (u64)size << 1;
+	bcast->reserved = pos + span;
+
+	*bufp = (byte *)(__whl_bcast_at(bcast, pos) + 1);
+	return pos % bcast->size;
+}
+
+/* called after `whl_bcast_make_slice()` to let every consumer have the slice,
+ * slices are shared in the order they're made so this shares everything made
+ * so far and `offset` is only for symmetry with `whl_share_slice()` */
+void
+whl_bcast_share_slice(whl_bcast_t *bcast, whl_offset_t offset)
+{
+	(void)offset;
+	/* the release publishes the headers and messages */
+	atomic_store_explicit(&bcast->tail, bcast->reserved, memory_order_release);
+}
+
+/* gets the earliest shared slice that `consumer` hasn't returned, the same
+ * one until it's returned.
+ *
+ * returns WHL_INVALID_OFFSET if there isn't one */
+whl_offset_t
+whl_bcast_next_shared_slice(whl_bcast_t *bcast, size_t consumer,
+                            byte **bufp, size_t *size)
+{
+	whl_bcast_cursor_t *cursor = &bcast->cursors[consumer];
+	/* we're the only one that writes our head */
+	u64                 head = atomic_load_explicit(&cursor->head,
+	                                                memory_order_relaxed);
+	u64                 tag;
+
+	for (;;) {
+		/* only look at the producer's line if it looks like we're empty */
+		if (head == cursor->consumer_tail) {
+			cursor->consumer_tail = atomic_load_explicit(&bcast->tail,
+			                                             memory_order_acquire);
+			if (head == cursor->consumer_tail)
+				return WHL_INVALID_OFFSET;
+		}
+
+		tag = *__whl_bcast_at(bcast, head);
+		if (!(tag & WHL_BCAST_PADDING))
+			break;
+
+		head += tag >> 1;
+		atomic_store_explicit(&cursor->head, head, memory_order_release);
+	}
+
+	*bufp = (byte *)(__whl_bcast_at(bcast, head) + 1);
+	*size = tag >> 1;
+	return head % bcast->size;
+}
+
+/* gives the slice from `whl_bcast_next_shared_slice()` back, the producer gets
+ * the room once every consumer has.
+ *
+ * returns the number of slices returned, 1 */
+size_t
+whl_bcast_return_slice(whl_bcast_t *bcast, size_t consumer, whl_offset_t offset)
+{
+	whl_bcast_cursor_t *cursor = &bcast->cursors[consumer];
+	u64                 head = atomic_load_explicit(&cursor->head,
+	                                                memory_order_relaxed);
+
+	/* the release hands the slice back after we're done reading it */
+	atomic_store_explicit(&cursor->head,
+	                      head + __whl_bcast_span(*__whl_bcast_at(bcast, offset) >> 1),
+	                      memory_order_release);
+	return 1;
+}
+
+/* `consumer` won't read anything else, the producer stops waiting on it */
+void
+whl_bcast_leave(whl_bcast_t *bcast, size_t consumer)
+{
+	atomic_store_explicit(&bcast->cursors[consumer].head, WHL_INVALID_POS,
+	                      memory_order_release);
+}
+
+/* like `whl_efd_init()` for an already initialized `whl_bcast_t`, in the
+ * producer's process. it makes a readable eventfd for each consumer and the
+ * writable one, pass each consumer theirs from `whl_bcast_efd_fds()`.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_bcast_efd_init(whl_bcast_efd_t *efd, whl_bcast_t *bcast)
+{
+	/* see __whl_efd_open() for why EFD_SEMAPHORE */
+	int flags = EFD_NONBLOCK | EFD_CLOEXEC | EFD_SEMAPHORE;
+
+	*efd = (whl_bcast_efd_t) {
+		.bcast = bcast,
+		.consumer = -1,
+	};
+
+	if (__whl_efd_open(bcast->cursors[0].is_readable, bcast->is_writable,
+	                   &efd->readable[0], &efd->writable) < 0)
+		return -1;
+
+	for (u64 i = 1; i < bcast->consumers; i++) {
+		efd->readable[i] = eventfd(bcast->cursors[i].is_readable, flags);
+		if (efd->readable[i] < 0) {
+			int no_clobber = errno;
+			while (i--)
+				close(efd->readable[i]);
+			close(efd->writable);
+			errno = no_clobber;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* like `whl_efd_init_from_eventfds()` in `consumer`'s process */
+void
+whl_bcast_efd_init_from_eventfds(whl_bcast_efd_t *efd, whl_bcast_t *bcast,
+                                 size_t consumer, int readable, int writable)
+{
+	*efd = (whl_bcast_efd_t) {
+		.bcast = bcast,
+		.consumer = consumer,
+		.writable = writable,
+	};
+	efd->readable[consumer] = readable;
+}
+
+/* closes the eventfd file descriptors this has */
+void
+whl_bcast_efd_close(whl_bcast_efd_t *efd)
+{
+	if (efd->consumer < 0)
+		for (u64 i = 0; i < efd->bcast->consumers; i++)
+			close(efd->readable[i]);
+	else
+		close(efd->readable[efd->consumer]);
+	close(efd->writable);
+}
+
+/* like `whl_efd_fds()` for `consumer`'s eventfds */
+void
+whl_bcast_efd_fds(whl_bcast_efd_t *efd, size_t consumer,
+                  int *readable, int *writable)
+{
+	*readable = efd->readable[consumer];
+	*writable = efd->writable;
+}
+
+/* `whl_bcast_t` version of `whl_efd_make_slice()` */
+whl_offset_t
+whl_bcast_efd_make_slice(whl_bcast_efd_t *efd, byte **bufp, size_t size)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->bcast->writable_guard, ~0);
+
+	whl_offset_t offset = whl_bcast_make_slice(efd->bcast, bufp, size);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unwritable(&efd->bcast->writable_state, efd->writable);
+
+	return offset;
+}
+
+/* `whl_bcast_t` version of `whl_efd_share_slice()`, makes every consumer's
+ * readable eventfd readable */
+void
+whl_bcast_efd_share_slice(whl_bcast_efd_t *efd, whl_offset_t offset)
+{
+	whl_bcast_t *bcast = efd->bcast;
+
+	for (u64 i = 0; i < bcast->consumers; i++)
+		atomic_store(&bcast->cursors[i].readable_guard, 0);
+
+	whl_bcast_share_slice(bcast, offset);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	for (u64 i = 0; i < bcast->consumers; i++)
+		__whl_efd_readable(&bcast->cursors[i].readable_state,
+		                   efd->readable[i]);
+}
+
+/* `whl_bcast_t` version of `whl_efd_next_shared_slice()` */
+whl_offset_t
+whl_bcast_efd_next_shared_slice(whl_bcast_efd_t *efd, byte **bufp, size_t *size)
+{
+	whl_bcast_cursor_t *cursor = &efd->bcast->cursors[efd->consumer];
+
+	atomic_store(&cursor->readable_guard, ~0);
+
+	whl_offset_t offset = whl_bcast_next_shared_slice(efd->bcast, efd->consumer,
+	                                                  bufp, size);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unreadable(&cursor->readable_state,
+		                     efd->readable[efd->consumer]);
+
+	return offset;
+}
+
+/* `whl_bcast_t` version of `whl_efd_return_slice()`, the producer might still
+ * be waiting on another consumer after this makes it writable */
+size_t
+whl_bcast_efd_return_slice(whl_bcast_efd_t *efd, whl_offset_t offset)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->bcast->writable_guard, 0);
+
+	size_t r = whl_bcast_return_slice(efd->bcast, efd->consumer, offset);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (r > 0)
+		__whl_efd_writable(&efd->bcast->writable_state, efd->writable);
+
+	return r;
+}
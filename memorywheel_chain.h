@@ -0,0 +1,451 @@
+/* a memory wheel that doesn't block the producer when it's full, instead the
+ * producer makes an overflow segment, another wheel in a new memfd, sends that
+ * to the consumer with `send_fd()` from scm.c and carries on in there.
+ *
+ * the consumer reads each segment until it's empty and the producer has moved
+ * on from it, then follows on to the next one and lets go of the one it left.
+ * once the consumer has left the primary segment, the first one, the producer
+ * goes back to it from whatever overflow segment it's on. so the primary only
+ * has to be big enough for the usual load and the overflow segments come and
+ * go with bursts.
+ *
+ * the total size of the shared memory in use is capped, after that
+ * `whl_chain_make_slice()` fails like `whl_make_slice()` does when the wheel is
+ * full. `whl_chain_stats()` says how often the producer overflowed and how big
+ * it all got.
+ *
+ * it uses `whl_t` on each segment, so it follows WHL_SPLIT and the other
+ * options like the rest. define _GNU_SOURCE before including anything for
+ * `memfd_create()`, include scm.h and memorywheel.h before this, and link
+ * scm.c.
+ *
+ * writer:
+ * - `whl_chain_producer_init()` makes the primary segment and sends it
+ * - `whl_chain_make_slice()` and `whl_chain_share_slice()`, share or abort each
+ *   slice before making the next, since making one can move to another
+ *   segment
+ *
+ * reader:
+ * - `whl_chain_consumer_init()` receives the primary segment
+ * - `whl_chain_next_shared_slice()` and `whl_chain_return_slice()`, return
+ *   each slice before getting the next */
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* `whl_chain_seg_t` `next` */
+typedef enum {
+	WHL_CHAIN_NEXT_NONE    = 0x0,
+	/* the producer sent a new segment over the socket */
+	WHL_CHAIN_NEXT_NEW     = 0x1,
+	/* the producer went back to the primary segment */
+	WHL_CHAIN_NEXT_PRIMARY = 0x2,
+} whl_chain_next_e;
+
+/* lives in shared memory at the start of each segment, the segment's `whl_t`
+ * follows at WHL_CHAIN_HEADER_SIZE */
+typedef struct {
+	/* WHL_CHAIN_NEXT_NONE until the producer moves on from this segment,
+	 * nothing is shared here after that */
+	_Atomic u8  next;
+	/* only in the primary, set by the consumer once it has left the primary
+	 * and cleared by the producer when it goes back */
+	_Atomic u8  drained;
+	/* only in the primary, the total size of overflow segments made by the
+	 * producer and not yet let go by the consumer */
+	_Atomic u64 overflow_size;
+} whl_chain_seg_t;
+
+/* so slices in the segment's wheel line up with any alignment */
+#define WHL_CHAIN_HEADER_SIZE WHL_ALIGN_MAX
+
+__whl_staticassert(whl_chain_seg_t_sizeof, sizeof(whl_chain_seg_t) <= WHL_CHAIN_HEADER_SIZE);
+
+/* only counted by the producer */
+typedef struct {
+	/* overflow segments made */
+	u64 overflows;
+	/* times the producer went back to the primary segment */
+	u64 rejoins;
+	/* times the producer ran into the cap, once each time until it makes a
+	 * slice again, not for every try in between */
+	u64 capped;
+	/* the most shared memory in use at once, the primary included */
+	u64 peak_size;
+} whl_chain_stats_t;
+
+/* one for each end, in non-shared memory */
+typedef struct {
+	/* where segments are sent or received */
+	int               sockfd;
+	whl_chain_seg_t  *primary;
+	size_t            primary_size;
+	/* the segment being written or read */
+	whl_chain_seg_t  *current;
+	size_t            current_size;
+	/* the rest is only used by the producer */
+	/* the size of each overflow segment */
+	size_t            seg_size;
+	/* the cap on the primary and overflow segments' total size */
+	size_t            max_size;
+	size_t            align;
+	/* set when moving to a segment and cleared once a slice is made there,
+	 * if making a slice fails in a segment with nothing in it, it won't fit in
+	 * another either */
+	u8                fresh;
+	/* set when another segment would go over the cap and cleared once a
+	 * slice is made, so `stats.capped` counts each time it fills up once */
+	u8                at_cap;
+	whl_chain_stats_t stats;
+} whl_chain_t;
+
+#define __whl_chain_wheel(seg) \
+	((whl_t *)((byte *)(seg) + WHL_CHAIN_HEADER_SIZE))
+
+whl_chain_seg_t *
+__whl_chain_map(int memfd, size_t size)
+{
+	void *seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	return seg == MAP_FAILED ? NULL : seg;
+}
+
+/* makes, maps and initializes a segment of `size` bytes,
+ * returns NULL with errno set on error */
+whl_chain_seg_t *
+__whl_chain_make_seg(size_t size, size_t align, int *memfd)
+{
+	whl_chain_seg_t *seg;
+
+	if (size <= WHL_CHAIN_HEADER_SIZE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((*memfd = memfd_create("memorywheel-chain", MFD_CLOEXEC)) < 0)
+		return NULL;
+
+	if (   ftruncate(*memfd, size) < 0
+	    || (seg = __whl_chain_map(*memfd, size)) == NULL)
+		goto fail;
+
+	*seg = (whl_chain_seg_t) {
+		.next = WHL_CHAIN_NEXT_NONE,
+		.drained = 0,
+		.overflow_size = 0,
+	};
+
+	if (whl_init_aligned(__whl_chain_wheel(seg),
+	                     size - WHL_CHAIN_HEADER_SIZE, align) < 0) {
+		munmap(seg, size);
+		errno = EINVAL;
+		goto fail;
+	}
+
+	return seg;
+
+fail:
+	{
+		int no_clobber = errno;
+		close(*memfd);
+		errno = no_clobber;
+	}
+	return NULL;
+}
+
+/* makes the primary segment of `size` bytes and sends its memfd over `sockfd`.
+ * overflow segments are `seg_size` bytes and the total size of the segments
+ * is at most `max_size`. `align` is passed to `whl_init_aligned()` for each
+ * segment.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_chain_producer_init(whl_chain_t *chain, int sockfd, size_t size,
+                        size_t seg_size, size_t max_size, size_t align)
+{
+	whl_chain_seg_t *primary;
+	int              memfd;
+
+	if (   seg_size <= WHL_CHAIN_HEADER_SIZE
+	    || max_size < size
+	    || (primary = __whl_chain_make_seg(size, align, &memfd)) == NULL)
+		return -1;
+
+	if (send_fd(sockfd, memfd) == (size_t)-1) {
+		munmap(primary, size);
+		close(memfd);
+		return -1;
+	}
+
+	close(memfd);
+
+	*chain = (whl_chain_t) {
+		.sockfd = sockfd,
+		.primary = primary,
+		.primary_size = size,
+		.current = primary,
+		.current_size = size,
+		.seg_size = seg_size,
+		.max_size = max_size,
+		.align = align,
+		.fresh = 1,
+		.at_cap = 0,
+		.stats = { .peak_size = size },
+	};
+	return 0;
+}
+
+/* receives the primary segment from `whl_chain_producer_init()` over
+ * `sockfd`.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_chain_consumer_init(whl_chain_t *chain, int sockfd)
+{
+	whl_chain_seg_t *primary;
+	struct stat      st;
+	int              memfd;
+
+	if (recv_fd(sockfd, &memfd) != 1)
+		return -1;
+
+	if (   fstat(memfd, &st) < 0
+	    || (primary = __whl_chain_map(memfd, st.st_size)) == NULL) {
+		close(memfd);
+		return -1;
+	}
+
+	close(memfd);
+
+	*chain = (whl_chain_t) {
+		.sockfd = sockfd,
+		.primary = primary,
+		.primary_size = st.st_size,
+		.current = primary,
+		.current_size = st.st_size,
+	};
+	return 0;
+}
+
+/* unmaps the segments still mapped by this end */
+void
+whl_chain_close(whl_chain_t *chain)
+{
+	if (chain->current != chain->primary)
+		munmap(chain->current, chain->current_size);
+	munmap(chain->primary, chain->primary_size);
+}
+
+/* the producer leaves the current segment for `seg`, telling the consumer how
+ * to get there with `next` */
+void
+__whl_chain_move(whl_chain_t *chain, whl_chain_next_e next,
+                 whl_chain_seg_t *seg, size_t size)
+{
+	whl_chain_seg_t *old = chain->current;
+
+	/* everything shared in `old` is visible before this */
+	atomic_store_explicit(&old->next, next, memory_order_release);
+
+	if (old != chain->primary)
+		munmap(old, chain->current_size);
+
+	chain->current = seg;
+	chain->current_size = size;
+	chain->fresh = 1;
+}
+
+/* sends a new overflow segment and moves to it,
+ * returns non-zero if it can't because of the cap or an error */
+int
+__whl_chain_overflow(whl_chain_t *chain)
+{
+	whl_chain_seg_t *seg;
+	int              memfd;
+	u64              total = chain->primary_size
+	                       + atomic_load(&chain->primary->overflow_size)
+	                       + chain->seg_size;
+
+	if (total > chain->max_size) {
+		if (!chain->at_cap)
+			chain->stats.capped++;
+		chain->at_cap = 1;
+		return -1;
+	}
+
+	if ((seg = __whl_chain_make_seg(chain->seg_size, chain->align, &memfd)) == NULL)
+		return -1;
+
+	/* before sending, the consumer can only let go of it after that */
+	atomic_fetch_add(&chain->primary->overflow_size, chain->seg_size);
+
+	if (send_fd(chain->sockfd, memfd) == (size_t)-1) {
+		int no_clobber = errno;
+		atomic_fetch_sub(&chain->primary->overflow_size, chain->seg_size);
+		munmap(seg, chain->seg_size);
+		close(memfd);
+		errno = no_clobber;
+		return -1;
+	}
+
+	close(memfd);
+
+	__whl_chain_move(chain, WHL_CHAIN_NEXT_NEW, seg, chain->seg_size);
+
+	chain->stats.overflows++;
+	if (total > chain->stats.peak_size)
+		chain->stats.peak_size = total;
+	return 0;
+}
+
+/* like `whl_make_slice()`, but if the current segment is full this moves on to
+ * a new overflow segment instead of failing, unless that would go over the
+ * cap. also goes back to the primary segment when the consumer is done with
+ * it.
+ *
+ * returns WHL_INVALID_OFFSET if it's all full or on error */
+whl_offset_t
+whl_chain_make_slice(whl_chain_t *chain, byte **bufp, size_t size)
+{
+	whl_offset_t offset;
+
+	if (   chain->current != chain->primary
+	    && atomic_load_explicit(&chain->primary->drained, memory_order_acquire)) {
+		/* the consumer isn't in the primary, so it's empty and only the
+		 * consumer looks at these after it follows `next` */
+		atomic_store_explicit(&chain->primary->next, WHL_CHAIN_NEXT_NONE,
+		                      memory_order_relaxed);
+		atomic_store_explicit(&chain->primary->drained, 0,
+		                      memory_order_relaxed);
+		__whl_chain_move(chain, WHL_CHAIN_NEXT_PRIMARY,
+		                 chain->primary, chain->primary_size);
+		chain->stats.rejoins++;
+	}
+
+	offset = whl_make_slice(__whl_chain_wheel(chain->current), bufp, size);
+
+	if (offset == WHL_INVALID_OFFSET) {
+		if (chain->fresh || __whl_chain_overflow(chain) != 0)
+			return WHL_INVALID_OFFSET;
+
+		offset = whl_make_slice(__whl_chain_wheel(chain->current), bufp, size);
+
+		if (offset == WHL_INVALID_OFFSET)
+			return WHL_INVALID_OFFSET;
+	}
+
+	chain->fresh = 0;
+	chain->at_cap = 0;
+	return offset;
+}
+
+/* like `whl_share_slice()` for a slice from `whl_chain_make_slice()` */
+void
+whl_chain_share_slice(whl_chain_t *chain, whl_offset_t offset)
+{
+	whl_share_slice(__whl_chain_wheel(chain->current), offset);
+}
+
+/* like `whl_abort_slice()` for a slice from `whl_chain_make_slice()` */
+int
+whl_chain_abort_slice(whl_chain_t *chain, whl_offset_t offset)
+{
+	return whl_abort_slice(__whl_chain_wheel(chain->current), offset);
+}
+
+/* the consumer follows `next` out of the current segment and lets go of it,
+ * returns non-zero on error */
+int
+__whl_chain_follow(whl_chain_t *chain, whl_chain_next_e next)
+{
+	whl_chain_seg_t *old = chain->current;
+	size_t           old_size = chain->current_size;
+
+	if (next == WHL_CHAIN_NEXT_NEW) {
+		struct stat st;
+		int         memfd;
+
+		/* it was sent before `next` was set so this doesn't wait */
+		if (recv_fd(chain->sockfd, &memfd) != 1)
+			return -1;
+
+		if (   fstat(memfd, &st) < 0
+		    || (chain->current = __whl_chain_map(memfd, st.st_size)) == NULL) {
+			int no_clobber = errno;
+			chain->current = old;
+			close(memfd);
+			errno = no_clobber;
+			return -1;
+		}
+
+		close(memfd);
+		chain->current_size = st.st_size;
+	} else {
+		chain->current = chain->primary;
+		chain->current_size = chain->primary_size;
+	}
+
+	if (old == chain->primary) {
+		atomic_store_explicit(&chain->primary->drained, 1,
+		                      memory_order_release);
+	} else {
+		munmap(old, old_size);
+		atomic_fetch_sub(&chain->primary->overflow_size, old_size);
+	}
+
+	return 0;
+}
+
+/* like `whl_next_shared_slice()` but follows the producer through the
+ * segments.
+ *
+ * returns WHL_INVALID_OFFSET if nothing is shared or on error */
+whl_offset_t
+whl_chain_next_shared_slice(whl_chain_t *chain, byte **bufp, size_t *size)
+{
+	whl_offset_t offset;
+	u8           next;
+
+	for (;;) {
+		offset = whl_next_shared_slice(__whl_chain_wheel(chain->current),
+		                               bufp, size);
+		if (offset != WHL_INVALID_OFFSET)
+			return offset;
+
+		next = atomic_load_explicit(&chain->current->next,
+		                            memory_order_acquire);
+		if (next == WHL_CHAIN_NEXT_NONE)
+			return WHL_INVALID_OFFSET;
+
+		/* look once more, something may have been shared between the first
+		 * look and the producer moving on */
+		offset = whl_next_shared_slice(__whl_chain_wheel(chain->current),
+		                               bufp, size);
+		if (offset != WHL_INVALID_OFFSET)
+			return offset;
+
+		if (__whl_chain_follow(chain, next) != 0)
+			return WHL_INVALID_OFFSET;
+	}
+}
+
+/* like `whl_return_slice()` for a slice from `whl_chain_next_shared_slice()` */
+size_t
+whl_chain_return_slice(whl_chain_t *chain, whl_offset_t offset)
+{
+	return whl_return_slice(__whl_chain_wheel(chain->current), offset);
+}
+
+/* the producer's counts so far */
+whl_chain_stats_t
+whl_chain_stats(const whl_chain_t *chain)
+{
+	return chain->stats;
+}
+
+/* the total size of the segments in use now, from either end */
+u64
+whl_chain_size(const whl_chain_t *chain)
+{
+	return chain->primary_size + atomic_load(&chain->primary->overflow_size);
+}
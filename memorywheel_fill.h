@@ -0,0 +1,115 @@
+/* lets a few threads fill the slices of one wheel at once, for producers where
+ * writing the messages takes longer than making and sharing them. one thread
+ * makes each slice and hands out its buffer, workers fill them in any order
+ * and say when they're done, and the slices are shared in the order they were
+ * made so the consumer never sees one before an earlier one.
+ *
+ * the thread that makes slices is the only one that touches the wheel, it
+ * shares everything done with nothing before it still being filled whenever
+ * it makes a slice or calls `whl_fill_share()`. the slices that share goes
+ * over are shared at once with `whl_share_slices()`. a worker only stores
+ * that it's done, it never waits on the others.
+ *
+ * the producer doesn't know about any of this, it's a `whl_t` made and shared
+ * like usual. the `whl_fill_t` lives in the producing process's memory, not
+ * the shared memory. don't make slices in the wheel other than through it.
+ * include memorywheel.h before this.
+ *
+ * maker:
+ * - `whl_fill_make_slice()`, gives a ticket and the buffer to a worker
+ * - `whl_fill_share()`, while there's nothing to make
+ *
+ * workers:
+ * - `whl_fill_done()` */
+
+/* the most slices made and not shared yet at once, a power of two */
+#define WHL_FILL_PENDING 256
+#define WHL_FILL_INVALID UINT64_MAX
+
+/* in non-shared memory */
+typedef struct {
+	whl_t       *wheel;
+	/* the maker's, the number of slices made */
+	u64          made;
+	/* the maker's, the number of slices shared */
+	u64          shared;
+	/* the maker's, each made slice's offset by ticket */
+	whl_offset_t offsets[WHL_FILL_PENDING];
+	/* written by the workers, the ticket plus one once it's filled */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64  done[WHL_FILL_PENDING];
+} whl_fill_t;
+
+void
+whl_fill_init(whl_fill_t *fill, whl_t *wheel)
+{
+	fill->wheel = wheel;
+	fill->made = 0;
+	fill->shared = 0;
+	for (size_t i = 0; i < WHL_FILL_PENDING; i++)
+		atomic_init(&fill->done[i], 0);
+}
+
+/* only the maker calls this. shares the slices that are filled, in the order
+ * they were made, up to the first one that isn't.
+ *
+ * returns the number of slices shared */
+size_t
+whl_fill_share(whl_fill_t *fill)
+{
+	u64 end = fill->shared;
+	u64 start;
+
+	while (   end < fill->made
+	       && atomic_load_explicit(&fill->done[end % WHL_FILL_PENDING],
+	                               memory_order_acquire) == end + 1)
+		end++;
+
+	/* the offsets are contiguous in `offsets` apart from wrapping */
+	for (start = fill->shared; start < end; ) {
+		u64 n = WHL_FILL_PENDING - start % WHL_FILL_PENDING;
+		if (n > end - start)
+			n = end - start;
+		whl_share_slices(fill->wheel,
+		                 &fill->offsets[start % WHL_FILL_PENDING], n);
+		start += n;
+	}
+
+	start = fill->shared;
+	fill->shared = end;
+	return end - start;
+}
+
+/* only the maker calls this. shares what's filled, then makes a slice like
+ * `whl_make_slice()` for a worker to write to and gives back the ticket to
+ * pass to `whl_fill_done()` with it.
+ *
+ * returns WHL_FILL_INVALID if the wheel is full or WHL_FILL_PENDING slices
+ * are already waiting to be filled or shared, *bufp is untouched */
+u64
+whl_fill_make_slice(whl_fill_t *fill, byte **bufp, size_t size)
+{
+	whl_offset_t offset;
+
+	whl_fill_share(fill);
+
+	if (fill->made - fill->shared == WHL_FILL_PENDING)
+		return WHL_FILL_INVALID;
+
+	offset = whl_make_slice(fill->wheel, bufp, size);
+	if (offset == WHL_INVALID_OFFSET)
+		return WHL_FILL_INVALID;
+
+	fill->offsets[fill->made % WHL_FILL_PENDING] = offset;
+	return fill->made++;
+}
+
+/* any worker calls this once it's done writing to the slice for `ticket`.
+ * it's shared by the maker once every slice made before it is done too. */
+void
+whl_fill_done(whl_fill_t *fill, u64 ticket)
+{
+	/* the release hands the maker what we wrote */
+	atomic_store_explicit(&fill->done[ticket % WHL_FILL_PENDING], ticket + 1,
+	                      memory_order_release);
+}
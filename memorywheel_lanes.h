@@ -0,0 +1,269 @@
+/* a few memory wheels of their own sizes, lanes, in the same shared memory
+ * under one header. the producer picks a lane for each message and the
+ * consumer always takes from the first lane with something shared in it, so
+ * lane 0 goes ahead of lane 1 and so on. a small message in lane 0 doesn't
+ * wait behind a lot of big ones in lane 1.
+ *
+ * each lane is a `whl_t`, so it follows WHL_SPLIT and the other options like
+ * the rest. include memorywheel.h before this.
+ *
+ * `whl_lanes_efd_t` polls like `whl_efd_t` with one pair of eventfds for all
+ * the lanes. readable is readable when any lane has something shared.
+ * writable is unwritable after making a slice in a lane fails and writable
+ * again after a slice is returned in any lane, which might not be the lane
+ * that was full.
+ *
+ * writer:
+ * - `whl_lanes_make_slice()` and `whl_lanes_share_slice()` for a lane
+ *
+ * reader:
+ * - `whl_lanes_next_shared_slice()` gets the earliest shared slice in the
+ *   first lane with one and says which lane
+ * - `whl_lanes_return_slice()` for that lane */
+
+#define WHL_LANES_MAX         8
+#define WHL_LANES_HEADER_SIZE (4 * WHL_CACHE_LINE)
+
+/* lives in shared memory, at the start of it, the lanes follow */
+typedef struct {
+	/* the number of lanes, read-only after `whl_lanes_init()` */
+	u8  count;
+	/* how far each lane's `whl_t` is after the start of this,
+	 * read-only after `whl_lanes_init()` */
+	u64 offsets[WHL_LANES_MAX];
+	/* like in `whl_atomic_t` but for all lanes */
+	_Alignas(WHL_CACHE_LINE)
+	union {
+		struct {
+			_Atomic u8 readable_guard;
+			/* initially 0. set to 1 when a slice is shared. */
+			_Atomic u8 is_readable;
+		};
+		_Atomic whl_u8_pair_t readable_state;
+	};
+	union {
+		struct {
+			_Atomic u8 writable_guard;
+			/* initially 1. set to 0 when making a slice fails. */
+			_Atomic u8 is_writable;
+		};
+		_Atomic whl_u8_pair_t writable_state;
+	};
+} whl_lanes_t;
+
+__whl_staticassert(whl_lanes_t_sizeof, sizeof(whl_lanes_t) <= WHL_LANES_HEADER_SIZE);
+
+/* a copy for each process, like `whl_efd_t` */
+typedef struct {
+	whl_lanes_t *lanes;
+	int          readable;
+	int          writable;
+} whl_lanes_efd_t;
+
+#define __whl_lanes_wheel(lanes, lane) \
+	((whl_t *)((byte *)(lanes) + (lanes)->offsets[(lane)]))
+
+/* `lanes` must point to allocated memory at least `buf_size` big, it should be
+ * shared memory. `count` lanes, at most WHL_LANES_MAX, follow the header in
+ * order, `sizes` are their sizes in bytes each including the lane's `whl_t`
+ * header. each is a multiple of 64 and big enough for `whl_init()`. lane 0
+ * goes first.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_lanes_init(whl_lanes_t *lanes, size_t buf_size,
+               const size_t *sizes, size_t count)
+{
+	u64 offset = WHL_LANES_HEADER_SIZE;
+
+	if (   count == 0
+	    || count > WHL_LANES_MAX
+	    || buf_size < WHL_LANES_HEADER_SIZE)
+		return -1;
+
+	*lanes = (whl_lanes_t) {
+		.count = count,
+		.is_readable = 0,
+		.is_writable = 1,
+	};
+
+	for (size_t i = 0; i < count; i++) {
+		if (   sizes[i] % WHL_CACHE_LINE != 0
+		    || sizes[i] > buf_size - offset
+		    || whl_init((whl_t *)((byte *)lanes + offset), sizes[i]) != 0)
+			return -1;
+
+		lanes->offsets[i] = offset;
+		offset += sizes[i];
+	}
+
+	return 0;
+}
+
+/* the `whl_t` of a lane */
+whl_t *
+whl_lanes_wheel(whl_lanes_t *lanes, size_t lane)
+{
+	return __whl_lanes_wheel(lanes, lane);
+}
+
+/* `whl_make_slice()` in `lane` */
+whl_offset_t
+whl_lanes_make_slice(whl_lanes_t *lanes, size_t lane,
+                     byte **bufp, size_t size)
+{
+	return whl_make_slice(__whl_lanes_wheel(lanes, lane), bufp, size);
+}
+
+/* `whl_share_slice()` in `lane` */
+void
+whl_lanes_share_slice(whl_lanes_t *lanes, size_t lane, whl_offset_t offset)
+{
+	whl_share_slice(__whl_lanes_wheel(lanes, lane), offset);
+}
+
+/* `whl_next_shared_slice()` in the first lane with a shared slice, which goes
+ * in *lanep.
+ *
+ * returns WHL_INVALID_OFFSET and *lanep is untouched if nothing is shared in
+ * any lane */
+whl_offset_t
+whl_lanes_next_shared_slice(whl_lanes_t *lanes, size_t *lanep,
+                            byte **bufp, size_t *size)
+{
+	for (size_t i = 0; i < lanes->count; i++) {
+		whl_offset_t offset =
+			whl_next_shared_slice(__whl_lanes_wheel(lanes, i), bufp, size);
+		if (offset != WHL_INVALID_OFFSET) {
+			*lanep = i;
+			return offset;
+		}
+	}
+
+	return WHL_INVALID_OFFSET;
+}
+
+/* `whl_return_slice()` in `lane` */
+size_t
+whl_lanes_return_slice(whl_lanes_t *lanes, size_t lane, whl_offset_t offset)
+{
+	return whl_return_slice(__whl_lanes_wheel(lanes, lane), offset);
+}
+
+/* like `whl_efd_init_from_eventfds()` */
+void
+whl_lanes_efd_init_from_eventfds(whl_lanes_efd_t *efd, whl_lanes_t *lanes,
+                                 int readable, int writable)
+{
+	*efd = (whl_lanes_efd_t) {
+		.lanes = lanes,
+		.readable = readable,
+		.writable = writable,
+	};
+}
+
+/* like `whl_efd_init()` for already initialized lanes
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_lanes_efd_init(whl_lanes_efd_t *efd, whl_lanes_t *lanes)
+{
+	int readable;
+	int writable;
+
+	if (__whl_efd_open(lanes->is_readable, lanes->is_writable,
+	                   &readable, &writable) < 0)
+		return -1;
+
+	whl_lanes_efd_init_from_eventfds(efd, lanes, readable, writable);
+	return 0;
+}
+
+/* closes the two eventfd file descriptors */
+void
+whl_lanes_efd_close(whl_lanes_efd_t *efd)
+{
+	close(efd->readable);
+	close(efd->writable);
+}
+
+/* like `whl_efd_fds()` */
+void
+whl_lanes_efd_fds(whl_lanes_efd_t *efd, int *readable, int *writable)
+{
+	*readable = efd->readable;
+	*writable = efd->writable;
+}
+
+/* `whl_lanes_t` version of `whl_efd_make_slice()` */
+whl_offset_t
+whl_lanes_efd_make_slice(whl_lanes_efd_t *efd, size_t lane,
+                         byte **bufp, size_t size)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->lanes->writable_guard, ~0);
+
+	whl_offset_t offset = whl_lanes_make_slice(efd->lanes, lane, bufp, size);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unwritable(&efd->lanes->writable_state, efd->writable);
+
+	return offset;
+}
+
+/* `whl_lanes_t` version of `whl_efd_share_slice()` */
+void
+whl_lanes_efd_share_slice(whl_lanes_efd_t *efd, size_t lane,
+                          whl_offset_t offset)
+{
+	atomic_store(&efd->lanes->readable_guard, 0);
+
+	whl_lanes_share_slice(efd->lanes, lane, offset);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	__whl_efd_readable(&efd->lanes->readable_state, efd->readable);
+}
+
+/* `whl_lanes_t` version of `whl_efd_next_shared_slice()`, only unreadable
+ * when polled if nothing is shared in any lane */
+whl_offset_t
+whl_lanes_efd_next_shared_slice(whl_lanes_efd_t *efd, size_t *lanep,
+                                byte **bufp, size_t *size)
+{
+	atomic_store(&efd->lanes->readable_guard, ~0);
+
+	whl_offset_t offset = whl_lanes_next_shared_slice(efd->lanes, lanep,
+	                                                  bufp, size);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unreadable(&efd->lanes->readable_state, efd->readable);
+
+	return offset;
+}
+
+/* `whl_lanes_t` version of `whl_efd_return_slice()` */
+size_t
+whl_lanes_efd_return_slice(whl_lanes_efd_t *efd, size_t lane,
+                           whl_offset_t offset)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->lanes->writable_guard, 0);
+
+	size_t r = whl_lanes_return_slice(efd->lanes, lane, offset);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (r > 0)
+		__whl_efd_writable(&efd->lanes->writable_state, efd->writable);
+
+	return r;
+}
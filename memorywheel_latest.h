@@ -0,0 +1,276 @@
+/* `whl_latest_t` only keeps the latest value, for feeds like snapshots or
+ * config where the consumer doesn't care about anything it missed. the
+ * producer never waits and the consumer never queues up history, it reads the
+ * newest value there is or nothing if it's already read that one.
+ *
+ * there are two buffers. the producer writes each new value into the one the
+ * latest value isn't in, then points the latest at it. each buffer has its own
+ * sequence number like a seqlock, twice the version of the value in it, or one
+ * less while the producer is writing it. the consumer copies a value out and
+ * checks that the buffer still has the version it loaded, before and after.
+ * it doesn't if the producer got two values ahead, then the consumer tries
+ * again with the newer one.
+ *
+ * it's one value per `whl_latest_t`, a channel with a few keys can use one
+ * for each. it's single-producer single-consumer. include memorywheel.h
+ * before this.
+ *
+ * `whl_latest_efd_t` has a readable eventfd like `whl_efd_t`'s that's
+ * readable when polled while there's a value the consumer hasn't read. there
+ * isn't a writable one since the producer never waits.
+ *
+ * writer:
+ * - `whl_latest_make_value()`
+ * - `whl_latest_share_value()`
+ *
+ * reader:
+ * - `whl_latest_read()` */
+/* a line each for the size, the producer, the consumer, and the eventfd
+ * state, the two buffers follow */
+#define WHL_LATEST_HEADER_SIZE (4 * WHL_CACHE_LINE)
+
+/* in front of each buffer, on its own line */
+typedef struct {
+	/* twice the version of the value in the buffer, one less while the
+	 * producer is writing it */
+	_Atomic u64 seq;
+	/* the size in bytes of the value in the buffer */
+	u64         size;
+} whl_latest_buf_t;
+
+/* shared counts, see `whl_latest_stats()` */
+typedef struct {
+	/* values shared by the producer, the latest one's version */
+	u64 shared;
+	/* the version of the value the consumer last read, or 0 */
+	u64 read;
+	/* values the consumer didn't read because a newer one came first */
+	u64 conflated;
+} whl_latest_stats_t;
+
+/* lives in shared memory, the buffers follow it */
+typedef struct {
+	/* the most bytes a value can be, a multiple of WHL_CACHE_LINE,
+	 * read-only after `whl_latest_init()` */
+	u64         size;
+	/* written by the producer, the version of the latest value which is in
+	 * buffer `version % 2`, or 0 before the first */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 version;
+	/* written by the consumer */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 read;
+	_Atomic u64 conflated;
+	/* like in `whl_atomic_t`, written by both */
+	_Alignas(WHL_CACHE_LINE)
+	union {
+		struct {
+			_Atomic u8 readable_guard;
+			/* initially 0. set to 1 when a value is shared. */
+			_Atomic u8 is_readable;
+		};
+		_Atomic whl_u8_pair_t readable_state;
+	};
+} whl_latest_t;
+
+__whl_staticassert(whl_latest_t_sizeof, sizeof(whl_latest_t) <= WHL_LATEST_HEADER_SIZE);
+
+/* a copy for each process, like `whl_efd_t` */
+typedef struct {
+	whl_latest_t *latest;
+	int           readable;
+} whl_latest_efd_t;
+
+#define __whl_latest_buf(latest, version) \
+	((whl_latest_buf_t *)((byte *)(latest) + WHL_LATEST_HEADER_SIZE \
+	                      + ((version) % 2) * (WHL_CACHE_LINE + (latest)->size)))
+
+/* `latest` must point to allocated memory at least `buf_size` big, aligned to
+ * a cache line, with room for two buffers of `size` bytes each and a line in
+ * front of each.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_latest_init(whl_latest_t *latest, size_t buf_size, size_t size)
+{
+	u64 aligned;
+	u64 room;
+
+	/* rounding it up to a line would wrap around */
+	if (   size > ~(u64)0 - (WHL_CACHE_LINE - 1)
+	    || buf_size < WHL_LATEST_HEADER_SIZE)
+		return -1;
+
+	aligned = (size + WHL_CACHE_LINE - 1) & ~(u64)(WHL_CACHE_LINE - 1);
+
+	/* for each buffer and the line in front of it */
+	room = (buf_size - WHL_LATEST_HEADER_SIZE) / 2;
+	if (room < WHL_CACHE_LINE || aligned > room - WHL_CACHE_LINE)
+		return -1;
+
+	*latest = (whl_latest_t) {
+		.size = aligned,
+		.version = 0,
+		.read = 0,
+		.conflated = 0,
+		.is_readable = 0,
+	};
+
+	for (u64 v = 0; v < 2; v++)
+		*__whl_latest_buf(latest, v) = (whl_latest_buf_t) { .seq = 0 };
+
+	return 0;
+}
+
+/* gets the buffer for the next value, the one the latest value isn't in.
+ * write at most the size given to `whl_latest_init()` to *bufp. */
+void
+whl_latest_make_value(whl_latest_t *latest, byte **bufp)
+{
+	/* we're the only one that writes version */
+	u64               next = atomic_load_explicit(&latest->version,
+	                                              memory_order_relaxed) + 1;
+	whl_latest_buf_t *buf = __whl_latest_buf(latest, next);
+
+	atomic_store_explicit(&buf->seq, 2 * next - 1, memory_order_relaxed);
+	/* the consumer must see seq go odd before the buffer changes */
+	atomic_thread_fence(memory_order_release);
+
+	*bufp = (byte *)buf + WHL_CACHE_LINE;
+}
+
+/* called after `whl_latest_make_value()` to make the value `size` bytes
+ * written to it the latest */
+void
+whl_latest_share_value(whl_latest_t *latest, size_t size)
+{
+	u64               next = atomic_load_explicit(&latest->version,
+	                                              memory_order_relaxed) + 1;
+	whl_latest_buf_t *buf = __whl_latest_buf(latest, next);
+
+	buf->size = size;
+	atomic_store_explicit(&buf->seq, 2 * next, memory_order_release);
+	atomic_store_explicit(&latest->version, next, memory_order_release);
+}
+
+/* copies the latest value into `buf`, which is `cap` bytes, and puts its size
+ * in *size. it's cut short at `cap`.
+ *
+ * returns non-zero if there's no value newer than the last one read */
+int
+whl_latest_read(whl_latest_t *latest, byte *buf, size_t cap, size_t *size)
+{
+	u64 read = atomic_load_explicit(&latest->read, memory_order_relaxed);
+
+	for (;;) {
+		u64 version = atomic_load_explicit(&latest->version,
+		                                   memory_order_acquire);
+		if (version == read)
+			return -1;
+
+		whl_latest_buf_t *vbuf = __whl_latest_buf(latest, version);
+		u64               seq = atomic_load_explicit(&vbuf->seq,
+		                                             memory_order_acquire);
+		u64               n = vbuf->size;
+
+		/* the producer is already two values ahead, writing or done
+		 * with another in the same buffer */
+		if (seq != 2 * version)
+			continue;
+
+		if (n > cap)
+			n = cap;
+		if (n > latest->size)
+			n = latest->size;
+		memcpy(buf, (byte *)vbuf + WHL_CACHE_LINE, n);
+
+		/* like a seqlock, the copy is only `version` if the buffer still
+		 * has it */
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&vbuf->seq, memory_order_relaxed) != seq)
+			continue;
+
+		atomic_store_explicit(&latest->conflated,
+		                      latest->conflated + version - read - 1,
+		                      memory_order_relaxed);
+		atomic_store_explicit(&latest->read, version, memory_order_relaxed);
+		*size = n;
+		return 0;
+	}
+}
+
+/* the shared counts, either end can look at them */
+whl_latest_stats_t
+whl_latest_stats(whl_latest_t *latest)
+{
+	return (whl_latest_stats_t) {
+		.shared = atomic_load_explicit(&latest->version, memory_order_relaxed),
+		.read = atomic_load_explicit(&latest->read, memory_order_relaxed),
+		.conflated = atomic_load_explicit(&latest->conflated,
+		                                  memory_order_relaxed),
+	};
+}
+
+/* like `whl_efd_init_from_eventfds()` with just the readable eventfd */
+void
+whl_latest_efd_init_from_eventfd(whl_latest_efd_t *efd, whl_latest_t *latest,
+                                 int readable)
+{
+	*efd = (whl_latest_efd_t) {
+		.latest = latest,
+		.readable = readable,
+	};
+}
+
+/* like `whl_efd_init()` for an already initialized `whl_latest_t`
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_latest_efd_init(whl_latest_efd_t *efd, whl_latest_t *latest)
+{
+	int readable;
+
+	if (__whl_efd_open(latest->is_readable, 0, &readable, NULL) < 0)
+		return -1;
+
+	whl_latest_efd_init_from_eventfd(efd, latest, readable);
+	return 0;
+}
+
+/* closes the eventfd file descriptor */
+void
+whl_latest_efd_close(whl_latest_efd_t *efd)
+{
+	close(efd->readable);
+}
+
+/* `whl_latest_t` version of `whl_efd_share_slice()` */
+void
+whl_latest_efd_share_value(whl_latest_efd_t *efd, size_t size)
+{
+	atomic_store(&efd->latest->readable_guard, 0);
+
+	whl_latest_share_value(efd->latest, size);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	__whl_efd_readable(&efd->latest->readable_state, efd->readable);
+}
+
+/* `whl_latest_t` version of `whl_efd_next_shared_slice()` */
+int
+whl_latest_efd_read(whl_latest_efd_t *efd, byte *buf, size_t cap, size_t *size)
+{
+	atomic_store(&efd->latest->readable_guard, ~0);
+
+	int r = whl_latest_read(efd->latest, buf, cap, size);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (r != 0)
+		__whl_efd_unreadable(&efd->latest->readable_state, efd->readable);
+
+	return r;
+}
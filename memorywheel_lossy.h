@@ -0,0 +1,278 @@
+/* `whl_lossy_t` is for channels where losing old messages is better than ever
+ * making the producer wait, like metrics or traces. when there's no room for
+ * a new message the producer takes back the oldest ones, read or not, so
+ * making a slice only fails if it's bigger than the whole ring.
+ *
+ * because the producer can write over a message while the consumer is reading
+ * it, the consumer copies each message out and then checks, like a seqlock,
+ * that it wasn't written over before trusting the copy. every message has a
+ * header with its sequence number, so the consumer can tell how many it
+ * missed. those counts and the number of copies thrown out for being torn are
+ * kept in the shared header, see `whl_lossy_stats()`.
+ *
+ * messages are laid out like in `whl_split_t`, in order with positions that
+ * only increase, each 16 byte aligned with a 16 byte header. one that doesn't
+ * fit before the end of the ring goes at the start after a padding header.
+ * it's single-producer single-consumer. include memorywheel.h before this.
+ *
+ * writer:
+ * - `whl_lossy_make_slice()`
+ * - `whl_lossy_share_slice()`, before making another
+ *
+ * reader:
+ * - `whl_lossy_read()` */
+
+/* a line for the size, the producer, and the consumer */
+#define WHL_LOSSY_HEADER_SIZE (3 * WHL_CACHE_LINE)
+#define WHL_LOSSY_ALIGN       16
+
+/* the low two bits of `whl_lossy_record_t` seq */
+typedef enum {
+	WHL_LOSSY_WRITING = 0x1,
+	WHL_LOSSY_SHARED  = 0x2,
+	/* nothing until the end of the ring, the next message is at the start */
+	WHL_LOSSY_PADDING = 0x3,
+} whl_lossy_state_e;
+
+/* in front of every message in the ring */
+typedef struct {
+	/* the message's sequence number shifted up two with whl_lossy_state_e,
+	 * padding has the number of the message after it */
+	_Atomic u64 seq;
+	/* the size in bytes of the message or the padding */
+	u64         size;
+} whl_lossy_record_t;
+
+/* shared counts, see `whl_lossy_stats()` */
+typedef struct {
+	/* messages shared by the producer */
+	u64 shared;
+	/* messages the consumer never got because they were written over */
+	u64 dropped;
+	/* copies the consumer threw out because they were written over while
+	 * it was copying them */
+	u64 torn;
+} whl_lossy_stats_t;
+
+/* lives in shared memory, the ring follows it */
+typedef struct {
+	/* the size of the ring in bytes, a multiple of WHL_LOSSY_ALIGN,
+	 * read-only after `whl_lossy_init()` */
+	u64         size;
+	/* written by the producer,
+	 * the position after the most recently shared message */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 tail;
+	/* the position of the oldest message not written over, it's stored
+	 * before writing over anything */
+	_Atomic u64 oldest;
+	_Atomic u64 shared;
+	/* the producer's, the position after the most recently made message */
+	u64         reserved;
+	/* the producer's, the sequence number of the next message */
+	u64         seq;
+	/* written by the consumer */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 dropped;
+	_Atomic u64 torn;
+	/* the consumer's, the position of the next message to read */
+	u64         head;
+	/* the consumer's, the sequence number it expects next */
+	u64         expect;
+	/* the consumer's, what it last loaded from tail */
+	u64         consumer_tail;
+} whl_lossy_t;
+
+__whl_staticassert(whl_lossy_t_sizeof, sizeof(whl_lossy_t) <= WHL_LOSSY_HEADER_SIZE);
+__whl_staticassert(whl_lossy_record_t_sizeof, sizeof(whl_lossy_record_t) == WHL_LOSSY_ALIGN);
+
+#define __whl_lossy_at(lossy, pos) \
+	((whl_lossy_record_t *)((byte *)(lossy) + WHL_LOSSY_HEADER_SIZE \
+	                        + (pos) % (lossy)->size))
+#define __whl_lossy_span(size) \
+	(sizeof(whl_lossy_record_t) \
+	 + (((u64)(size) + WHL_LOSSY_ALIGN - 1) & ~(u64)(WHL_LOSSY_ALIGN - 1)))
+
+/* `lossy` must point to allocated memory at least `buf_size` big, aligned to
+ * a cache line.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_lossy_init(whl_lossy_t *lossy, size_t buf_size)
+{
+	if (buf_size < WHL_LOSSY_HEADER_SIZE + 2 * WHL_LOSSY_ALIGN)
+		return -1;
+
+	*lossy = (whl_lossy_t) {
+		.size = (buf_size - WHL_LOSSY_HEADER_SIZE) & ~(u64)(WHL_LOSSY_ALIGN - 1),
+		.tail = 0,
+		.oldest = 0,
+		.shared = 0,
+		.dropped = 0,
+		.torn = 0,
+	};
+	return 0;
+}
+
+/* takes back the oldest messages until there's room for `span` bytes after
+ * `pad` bytes of padding at `start`, where the producer is about to write */
+void
+__whl_lossy_reclaim(whl_lossy_t *lossy, u64 start, u64 pad, u64 span)
+{
+	u64 end = start + pad + span;
+	u64 oldest = atomic_load_explicit(&lossy->oldest, memory_order_relaxed);
+
+	if (end - oldest <= lossy->size)
+		return;
+
+	/* they're our own headers so they're not going anywhere */
+	while (oldest < start && end - oldest > lossy->size) {
+		whl_lossy_record_t *record = __whl_lossy_at(lossy, oldest);
+		if ((atomic_load_explicit(&record->seq, memory_order_relaxed) & 0x3)
+		    == WHL_LOSSY_PADDING)
+			oldest += record->size;
+		else
+			oldest += __whl_lossy_span(record->size);
+	}
+
+	/* everything old is gone and the padding is written over too */
+	if (end - oldest > lossy->size)
+		oldest = start + pad;
+
+	atomic_store_explicit(&lossy->oldest, oldest, memory_order_relaxed);
+	/* the consumer must see oldest move before anything it guards changes */
+	atomic_thread_fence(memory_order_release);
+}
+
+/* like `whl_make_slice()` but takes back the oldest messages if there isn't
+ * room.
+ *
+ * returns WHL_INVALID_OFFSET only if `size` doesn't fit in the ring at all */
+whl_offset_t
+whl_lossy_make_slice(whl_lossy_t *lossy, byte **bufp, size_t size)
+{
+	u64 span = __whl_lossy_span(size);
+	u64 pos = lossy->reserved;
+	u64 pad = 0;
+
+	if (span > lossy->size)
+		return WHL_INVALID_OFFSET;
+
+	if (span > lossy->size - pos % lossy->size)
+		pad = lossy->size - pos % lossy->size;
+
+	__whl_lossy_reclaim(lossy, pos, pad, span);
+
+	if (pad) {
+		whl_lossy_record_t *padding = __whl_lossy_at(lossy, pos);
+		padding->size = pad;
+		atomic_store_explicit(&padding->seq,
+		                      lossy->seq << 2 | WHL_LOSSY_PADDING,
+		                      memory_order_relaxed);
+		pos += pad;
+	}
+
+	whl_lossy_record_t *record = __whl_lossy_at(lossy, pos);
+	record->size = size;
+	atomic_store_explicit(&record->seq, lossy->seq << 2 | WHL_LOSSY_WRITING,
+	                      memory_order_relaxed);
+
+	lossy->reserved = pos + span;
+
+	*bufp = (byte *)(record + 1);
+	return pos % lossy->size;
+}
+
+/* called after `whl_lossy_make_slice()` to let the consumer have the message,
+ * the one just made */
+void
+whl_lossy_share_slice(whl_lossy_t *lossy, whl_offset_t offset)
+{
+	whl_lossy_record_t *record = __whl_lossy_at(lossy, offset);
+
+	atomic_store_explicit(&record->seq, lossy->seq << 2 | WHL_LOSSY_SHARED,
+	                      memory_order_relaxed);
+	lossy->seq++;
+	atomic_store_explicit(&lossy->shared, lossy->seq, memory_order_relaxed);
+	/* the release on tail publishes the header and message */
+	atomic_store_explicit(&lossy->tail, lossy->reserved, memory_order_release);
+}
+
+/* copies the oldest message not yet read and not written over into `buf`,
+ * which is `cap` bytes, and puts its size in *size. a message bigger than
+ * `cap` is skipped and counted as dropped.
+ *
+ * returns non-zero if there's nothing new to read */
+int
+whl_lossy_read(whl_lossy_t *lossy, byte *buf, size_t cap, size_t *size)
+{
+	for (;;) {
+		/* we got lapped, jump ahead to what's left */
+		u64 oldest = atomic_load_explicit(&lossy->oldest, memory_order_acquire);
+		if (lossy->head < oldest)
+			lossy->head = oldest;
+
+		/* only look at tail if it looks like we're empty */
+		if (lossy->head >= lossy->consumer_tail) {
+			lossy->consumer_tail = atomic_load_explicit(&lossy->tail,
+			                                            memory_order_acquire);
+			if (lossy->head >= lossy->consumer_tail)
+				return -1;
+		}
+
+		whl_lossy_record_t *record = __whl_lossy_at(lossy, lossy->head);
+		u64                 seq = atomic_load_explicit(&record->seq,
+		                                               memory_order_acquire);
+		u64                 record_size = record->size;
+		/* the room after the header up to the end of the ring, a header
+		 * that's written over can say anything */
+		u64                 room = lossy->size - lossy->head % lossy->size
+		                           - sizeof(whl_lossy_record_t);
+
+		if (   (seq & 0x3) == WHL_LOSSY_SHARED
+		    && record_size <= cap
+		    && record_size <= room)
+			memcpy(buf, record + 1, record_size);
+
+		/* like a seqlock, if oldest moved past this while we were reading
+		 * then what we read might be torn */
+		atomic_thread_fence(memory_order_acquire);
+		if (   atomic_load_explicit(&lossy->oldest, memory_order_relaxed) > lossy->head
+		    || atomic_load_explicit(&record->seq, memory_order_relaxed) != seq) {
+			atomic_store_explicit(&lossy->torn, lossy->torn + 1,
+			                      memory_order_relaxed);
+			continue;
+		}
+
+		if ((seq & 0x3) == WHL_LOSSY_PADDING) {
+			lossy->head += record_size;
+			continue;
+		}
+
+		lossy->head += __whl_lossy_span(record_size);
+
+		/* too big for `buf` counts as dropped with the ones we missed */
+		atomic_store_explicit(&lossy->dropped,
+		                      lossy->dropped + (seq >> 2) - lossy->expect
+		                      + (record_size > cap),
+		                      memory_order_relaxed);
+		lossy->expect = (seq >> 2) + 1;
+
+		if (record_size > cap)
+			continue;
+
+		*size = record_size;
+		return 0;
+	}
+}
+
+/* the shared counts, either end can look at them */
+whl_lossy_stats_t
+whl_lossy_stats(whl_lossy_t *lossy)
+{
+	return (whl_lossy_stats_t) {
+		.shared = atomic_load_explicit(&lossy->shared, memory_order_relaxed),
+		.dropped = atomic_load_explicit(&lossy->dropped, memory_order_relaxed),
+		.torn = atomic_load_explicit(&lossy->torn, memory_order_relaxed),
+	};
+}
@@ -0,0 +1,576 @@
+/* `whl_mpmc_t` is a work queue for a few producers feeding a few consumers
+ * that compete for messages, each message is got by exactly one consumer.
+ *
+ * producers claim room like in `whl_mpsc_t`, comparing and exchanging a
+ * reservation position, and share in any order. consumers claim messages by
+ * comparing and exchanging a second position, the next message to hand out,
+ * and return them in any order. the room is only taken back in order, so
+ * whichever consumer returns a message moves the head over everything
+ * returned with nothing before it still out. only one consumer at a time does
+ * that, the others just mark theirs returned and leave it to that one.
+ *
+ * every message has an 8 byte header with its size and state and is 8 byte
+ * aligned, one that doesn't fit before the end of the ring goes at the start
+ * after a padding header. the room is zeroed when it's taken back, see
+ * memorywheel_mpsc.h. include memorywheel.h before this.
+ *
+ * `whl_mpmc_efd_t` waits on eventfds but not like `whl_efd_t`, which has
+ * one flag for readable that every waiter wakes up for. here the header
+ * counts the consumers and producers waiting, and each message shared or room
+ * taken back while any are posts the eventfd once. the eventfds are semaphores
+ * watched with EPOLLEXCLUSIVE, so each post wakes one waiter instead of all of
+ * them. with it every consumer has to use `whl_mpmc_efd_next_shared_slice()`
+ * and `whl_mpmc_efd_return_slice()`, whichever one moves the head posts for
+ * the room.
+ *
+ * writers:
+ * - `whl_mpmc_make_slice()`
+ * - `whl_mpmc_share_slice()`
+ *
+ * readers:
+ * - `whl_mpmc_next_shared_slice()`
+ * - `whl_mpmc_return_slice()` */
+#include <sys/epoll.h>
+
+/* a line each for the size, the producers, the consumers, and the waiters */
+#define WHL_MPMC_HEADER_SIZE (4 * WHL_CACHE_LINE)
+#define WHL_MPMC_ALIGN       8
+
+/* the low two bits of a message's header, then a bit for being returned, the
+ * size is shifted up over them */
+typedef enum {
+	/* zero, nothing's claimed this yet or it's still being claimed */
+	WHL_MPMC_EMPTY    = 0x0,
+	WHL_MPMC_WRITING  = 0x1,
+	WHL_MPMC_SHARED   = 0x2,
+	/* nothing until the end of the ring, the next message is at the start */
+	WHL_MPMC_PADDING  = 0x3,
+	/* or'd with WHL_MPMC_SHARED once a consumer's done with it */
+	WHL_MPMC_RETURNED = 0x4,
+} whl_mpmc_state_e;
+
+/* lives in shared memory, the ring follows it */
+typedef struct {
+	/* the size of the ring in bytes, a multiple of WHL_MPMC_ALIGN,
+	 * read-only after `whl_mpmc_init()` */
+	u64         size;
+	/* written by the producers, the position after the last claimed */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 reserved;
+	/* written by the producers, what one of them last loaded from head */
+	_Atomic u64 producer_head;
+	/* written by the consumers, the position of the next message to hand
+	 * out */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 claimed;
+	/* written by the consumer holding `reclaiming`, the position of the
+	 * oldest message not returned */
+	_Atomic u64 head;
+	atomic_flag reclaiming;
+	/* the consumers and producers waiting in `whl_mpmc_efd_wait_readable()`
+	 * and `whl_mpmc_efd_wait_writable()` */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u32 readers_waiting;
+	_Atomic u32 writers_waiting;
+} whl_mpmc_t;
+
+__whl_staticassert(whl_mpmc_t_sizeof, sizeof(whl_mpmc_t) <= WHL_MPMC_HEADER_SIZE);
+
+/* a copy for each process, like `whl_efd_t` */
+typedef struct {
+	whl_mpmc_t *mpmc;
+	int         readable;
+	int         writable;
+	/* this process's, watching `readable` and `writable` with
+	 * EPOLLEXCLUSIVE */
+	int         readable_epoll;
+	int         writable_epoll;
+} whl_mpmc_efd_t;
+
+#define __whl_mpmc_at(mpmc, pos) \
+	((_Atomic u64 *)((byte *)(mpmc) + WHL_MPMC_HEADER_SIZE + (pos) % (mpmc)->size))
+#define __whl_mpmc_span(size) \
+	(sizeof(u64) + (((u64)(size) + WHL_MPMC_ALIGN - 1) & ~(u64)(WHL_MPMC_ALIGN - 1)))
+/* the bytes a header says it takes up */
+#define __whl_mpmc_tag_span(tag) \
+	(((tag) & 0x3) == WHL_MPMC_PADDING ? (tag) >> 3 : __whl_mpmc_span((tag) >> 3))
+
+/* `mpmc` must point to allocated memory at least `buf_size` big, aligned to a
+ * cache line. this zeroes all of it.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_mpmc_init(whl_mpmc_t *mpmc, size_t buf_size)
+{
+	if (   buf_size < WHL_MPMC_HEADER_SIZE + 2 * WHL_MPMC_ALIGN
+	    || buf_size - WHL_MPMC_HEADER_SIZE > WHL_INVALID_OFFSET)
+		return -1;
+
+	memset(mpmc, 0, buf_size);
+
+	*mpmc = (whl_mpmc_t) {
+		.size = (buf_size - WHL_MPMC_HEADER_SIZE) & ~(u64)(WHL_MPMC_ALIGN - 1),
+		.reserved = 0,
+		.producer_head = 0,
+		.claimed = 0,
+		.head = 0,
+		.reclaiming = ATOMIC_FLAG_INIT,
+		.readers_waiting = 0,
+		.writers_waiting = 0,
+	};
+	return 0;
+}
+
+/* any producer calls this, like `whl_mpsc_make_slice()`.
+ *
+ * returns WHL_INVALID_OFFSET if there isn't room and *bufp is untouched */
+whl_offset_t
+whl_mpmc_make_slice(whl_mpmc_t *mpmc, byte **bufp, size_t size)
+{
+	u64 span = __whl_mpmc_span(size);
+	u64 pos = atomic_load_explicit(&mpmc->reserved, memory_order_relaxed);
+	u64 head;
+	u64 pad;
+
+	if (span > mpmc->size)
+		return WHL_INVALID_OFFSET;
+
+	for (;;) {
+		pad = 0;
+		if (span > mpmc->size - pos % mpmc->size)
+			pad = mpmc->size - pos % mpmc->size;
+
+		/* only look at the consumers' line if it looks like we're full,
+		 * the acquires pair with the consumer zeroing what it took back */
+		head = atomic_load_explicit(&mpmc->producer_head, memory_order_acquire);
+		if (pos + pad + span - head > mpmc->size) {
+			head = atomic_load_explicit(&mpmc->head, memory_order_acquire);
+			atomic_store_explicit(&mpmc->producer_head, head,
+			                      memory_order_release);
+		}
+
+		if (pos + pad + span - head > mpmc->size) {
+			/* see whl_mpsc_make_slice() */
+			u64 now = atomic_load_explicit(&mpmc->reserved,
+			                               memory_order_relaxed);
+			if (now == pos)
+				return WHL_INVALID_OFFSET;
+			pos = now;
+			continue;
+		}
+
+		/* the release passes on the zeroing we acquired with head to
+		 * consumers that see this reserved */
+		if (atomic_compare_exchange_weak_explicit(&mpmc->reserved,
+		                                          &pos, pos + pad + span,
+		                                          memory_order_release,
+		                                          memory_order_relaxed))
+			break;
+	}
+
+	if (pad) {
+		atomic_store_explicit(__whl_mpmc_at(mpmc, pos),
+		                      pad << 3 | WHL_MPMC_PADDING,
+		                      memory_order_release);
+		pos += pad;
+	}
+
+	/* keeps the size for sharing, consumers wait on it till then */
+	atomic_store_explicit(__whl_mpmc_at(mpmc, pos),
+	                      (u64)size << 3 | WHL_MPMC_WRITING,
+	                      memory_order_relaxed);
+
+	*bufp = (byte *)(__whl_mpmc_at(mpmc, pos) + 1);
+	return pos % mpmc->size;
+}
+
+/* the producer that made the slice at `offset` calls this to let a consumer
+ * have it, once every slice claimed before it is shared too */
+void
+whl_mpmc_share_slice(whl_mpmc_t *mpmc, whl_offset_t offset)
+{
+	_Atomic u64 *header = __whl_mpmc_at(mpmc, offset);
+	u64          tag = atomic_load_explicit(header, memory_order_relaxed);
+
+	/* publishes the message, seq_cst so waiting readers are looked at
+	 * after it in `whl_mpmc_efd_share_slice()` */
+	atomic_store_explicit(header, (tag & ~(u64)0x7) | WHL_MPMC_SHARED,
+	                      memory_order_seq_cst);
+}
+
+/* if the header at `pos` is for something that can be taken back, a message
+ * that's returned or padding that's claimed past */
+int
+__whl_mpmc_passed(whl_mpmc_t *mpmc, u64 pos, u64 tag)
+{
+	if ((tag & 0x7) == (WHL_MPMC_SHARED | WHL_MPMC_RETURNED))
+		return 1;
+
+	return    (tag & 0x7) == WHL_MPMC_PADDING
+	       && pos < atomic_load_explicit(&mpmc->claimed, memory_order_seq_cst);
+}
+
+/* moves the head over what's passed with nothing before it still out,
+ * zeroing it. only one consumer does this at a time, if another is already
+ * then it sees what we passed before it stops.
+ *
+ * returns the number of messages it moved over */
+size_t
+__whl_mpmc_reclaim(whl_mpmc_t *mpmc)
+{
+	size_t       returns = 0;
+	u64          head;
+	_Atomic u64 *header;
+	u64          tag;
+
+	for (;;) {
+		if (atomic_flag_test_and_set_explicit(&mpmc->reclaiming,
+		                                      memory_order_acquire))
+			return returns;
+
+		/* only we write head while we have the flag */
+		head = atomic_load_explicit(&mpmc->head, memory_order_relaxed);
+
+		for (;;) {
+			header = __whl_mpmc_at(mpmc, head);
+			tag = atomic_load_explicit(header, memory_order_seq_cst);
+
+			if (!__whl_mpmc_passed(mpmc, head, tag))
+				break;
+
+			u64 span = __whl_mpmc_tag_span(tag);
+			memset(header + 1, 0, span - sizeof(u64));
+			atomic_store_explicit(header, 0, memory_order_relaxed);
+			head += span;
+			/* the release hands the zeroed room back to the producers */
+			atomic_store_explicit(&mpmc->head, head, memory_order_release);
+
+			if ((tag & 0x3) != WHL_MPMC_PADDING)
+				returns++;
+		}
+
+		atomic_flag_clear_explicit(&mpmc->reclaiming, memory_order_seq_cst);
+
+		/* someone passed the head after we looked but before we let go
+		 * and left it to us, look again */
+		tag = atomic_load_explicit(header, memory_order_seq_cst);
+		if (!__whl_mpmc_passed(mpmc, head, tag))
+			return returns;
+	}
+}
+
+/* claims the earliest shared message not claimed by another consumer yet.
+ * it's this consumer's until it returns it.
+ *
+ * returns WHL_INVALID_OFFSET if the next message isn't shared yet */
+whl_offset_t
+whl_mpmc_next_shared_slice(whl_mpmc_t *mpmc, byte **bufp, size_t *size)
+{
+	u64          pos = atomic_load_explicit(&mpmc->claimed, memory_order_relaxed);
+	_Atomic u64 *header;
+	u64          tag;
+
+	for (;;) {
+		/* if nothing's reserved here yet then what's in the ring here
+		 * is a message a whole lap back that's not returned yet */
+		header = __whl_mpmc_at(mpmc, pos);
+		tag = pos < atomic_load_explicit(&mpmc->reserved, memory_order_acquire)
+		      ? atomic_load_explicit(header, memory_order_seq_cst)
+		      : WHL_MPMC_EMPTY;
+
+		/* if it's left over from a position someone else already claimed
+		 * and returned then the exchange fails, positions only increase */
+		if ((tag & 0x7) == WHL_MPMC_PADDING) {
+			/* seq_cst so it's seen by whoever's reclaiming when they
+			 * look again, or we get to reclaim it ourselves */
+			if (atomic_compare_exchange_weak_explicit(&mpmc->claimed,
+			                                          &pos, pos + (tag >> 3),
+			                                          memory_order_seq_cst,
+			                                          memory_order_relaxed)) {
+				pos += tag >> 3;
+				__whl_mpmc_reclaim(mpmc);
+			}
+			continue;
+		}
+
+		if ((tag & 0x7) != WHL_MPMC_SHARED) {
+			/* it might have been claimed, returned and zeroed since we
+			 * loaded pos, then there's more to look at */
+			u64 now = atomic_load_explicit(&mpmc->claimed,
+			                               memory_order_seq_cst);
+			if (now == pos)
+				return WHL_INVALID_OFFSET;
+			pos = now;
+			continue;
+		}
+
+		if (atomic_compare_exchange_weak_explicit(&mpmc->claimed,
+		                                          &pos, pos + __whl_mpmc_span(tag >> 3),
+		                                          memory_order_relaxed,
+		                                          memory_order_relaxed))
+			break;
+	}
+
+	*bufp = (byte *)(header + 1);
+	*size = tag >> 3;
+	return pos % mpmc->size;
+}
+
+/* the consumer that claimed the message at `offset` gives it back, in any
+ * order.
+ *
+ * returns the number of messages the head moved over, 0 if this one waits on
+ * one before it */
+size_t
+whl_mpmc_return_slice(whl_mpmc_t *mpmc, whl_offset_t offset)
+{
+	_Atomic u64 *header = __whl_mpmc_at(mpmc, offset);
+
+	/* seq_cst so either this sees the reclaiming flag cleared or whoever
+	 * cleared it sees this */
+	atomic_fetch_or_explicit(header, WHL_MPMC_RETURNED, memory_order_seq_cst);
+
+	return __whl_mpmc_reclaim(mpmc);
+}
+
+/* if a consumer could claim something now */
+int
+__whl_mpmc_any_shared(whl_mpmc_t *mpmc)
+{
+	u64 pos = atomic_load_explicit(&mpmc->claimed, memory_order_seq_cst);
+	u64 tag;
+
+	for (;;) {
+		/* see whl_mpmc_next_shared_slice() */
+		if (pos < atomic_load_explicit(&mpmc->reserved, memory_order_seq_cst)) {
+			tag = atomic_load_explicit(__whl_mpmc_at(mpmc, pos),
+			                           memory_order_seq_cst);
+			if (   (tag & 0x7) == WHL_MPMC_SHARED
+			    || (tag & 0x7) == WHL_MPMC_PADDING)
+				return 1;
+		}
+
+		u64 now = atomic_load_explicit(&mpmc->claimed, memory_order_seq_cst);
+		if (now == pos)
+			return 0;
+		pos = now;
+	}
+}
+
+/* makes a semaphore eventfd with an epoll instance watching it so only one
+ * waiter wakes per post */
+int
+__whl_mpmc_efd_epoll(int fd)
+{
+	struct epoll_event event = { .events = EPOLLIN | EPOLLEXCLUSIVE };
+	int                epoll = epoll_create1(EPOLL_CLOEXEC);
+
+	if (epoll < 0)
+		return -1;
+
+	if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+		int no_clobber = errno;
+		close(epoll);
+		errno = no_clobber;
+		return -1;
+	}
+
+	return epoll;
+}
+
+/* like `whl_efd_init_from_eventfds()`, this makes the epoll instances for
+ * this process
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_mpmc_efd_init_from_eventfds(whl_mpmc_efd_t *efd, whl_mpmc_t *mpmc,
+                                int readable, int writable)
+{
+	*efd = (whl_mpmc_efd_t) {
+		.mpmc = mpmc,
+		.readable = readable,
+		.writable = writable,
+	};
+
+	if ((efd->readable_epoll = __whl_mpmc_efd_epoll(readable)) < 0)
+		return -1;
+
+	if ((efd->writable_epoll = __whl_mpmc_efd_epoll(writable)) < 0) {
+		int no_clobber = errno;
+		close(efd->readable_epoll);
+		errno = no_clobber;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* like `whl_efd_init()` for an already initialized `whl_mpmc_t`, the eventfds
+ * start with nothing to read
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_mpmc_efd_init(whl_mpmc_efd_t *efd, whl_mpmc_t *mpmc)
+{
+	int flags = EFD_NONBLOCK | EFD_CLOEXEC | EFD_SEMAPHORE;
+	int readable;
+	int writable;
+	int no_clobber;
+
+	if ((readable = eventfd(0, flags)) < 0)
+		return -1;
+
+	if ((writable = eventfd(0, flags)) < 0)
+		goto close_readable;
+
+	if (whl_mpmc_efd_init_from_eventfds(efd, mpmc, readable, writable) < 0)
+		goto close_writable;
+
+	return 0;
+
+close_writable:
+	no_clobber = errno;
+	close(writable);
+	errno = no_clobber;
+close_readable:
+	no_clobber = errno;
+	close(readable);
+	errno = no_clobber;
+	return -1;
+}
+
+/* closes the eventfds and epoll instances */
+void
+whl_mpmc_efd_close(whl_mpmc_efd_t *efd)
+{
+	close(efd->readable_epoll);
+	close(efd->writable_epoll);
+	close(efd->readable);
+	close(efd->writable);
+}
+
+/* like `whl_efd_fds()`, these are what to pass to another process */
+void
+whl_mpmc_efd_fds(whl_mpmc_efd_t *efd, int *readable, int *writable)
+{
+	*readable = efd->readable;
+	*writable = efd->writable;
+}
+
+/* `whl_mpmc_t` version of `whl_efd_share_slice()`, posts one waiting
+ * consumer */
+void
+whl_mpmc_efd_share_slice(whl_mpmc_efd_t *efd, whl_offset_t offset)
+{
+	whl_mpmc_share_slice(efd->mpmc, offset);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	if (atomic_load_explicit(&efd->mpmc->readers_waiting, memory_order_seq_cst))
+		__whl_efd_write(efd->readable, 1);
+}
+
+/* posts one waiting producer if the head moved past `head`, which this
+ * consumer loaded before it might have moved it. if another consumer had the
+ * reclaiming flag and moved it instead then that one posts. */
+void
+__whl_mpmc_efd_reclaimed(whl_mpmc_efd_t *efd, u64 head)
+{
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	if (   atomic_load_explicit(&efd->mpmc->head, memory_order_seq_cst) != head
+	    && atomic_load_explicit(&efd->mpmc->writers_waiting, memory_order_seq_cst))
+		__whl_efd_write(efd->writable, 1);
+}
+
+/* `whl_mpmc_t` version of `whl_efd_next_shared_slice()`, claiming past
+ * padding can take back room so this posts one waiting producer if it did */
+whl_offset_t
+whl_mpmc_efd_next_shared_slice(whl_mpmc_efd_t *efd, byte **bufp, size_t *size)
+{
+	u64          head = atomic_load_explicit(&efd->mpmc->head, memory_order_relaxed);
+	whl_offset_t offset = whl_mpmc_next_shared_slice(efd->mpmc, bufp, size);
+
+	__whl_mpmc_efd_reclaimed(efd, head);
+	return offset;
+}
+
+/* `whl_mpmc_t` version of `whl_efd_return_slice()`, posts one waiting
+ * producer if that gave back room */
+size_t
+whl_mpmc_efd_return_slice(whl_mpmc_efd_t *efd, whl_offset_t offset)
+{
+	u64    head = atomic_load_explicit(&efd->mpmc->head, memory_order_relaxed);
+	size_t r = whl_mpmc_return_slice(efd->mpmc, offset);
+
+	__whl_mpmc_efd_reclaimed(efd, head);
+	return r;
+}
+
+/* waits on `epoll` for a post unless `ready()` already, counting ourselves in
+ * `waiting` meanwhile */
+int
+__whl_mpmc_efd_wait(whl_mpmc_t *mpmc, _Atomic u32 *waiting, int epoll, int fd,
+                    int (*ready)(whl_mpmc_t *), int timeout)
+{
+	struct epoll_event event;
+	u64                value;
+	int                r = 0;
+
+	atomic_fetch_add_explicit(waiting, 1, memory_order_seq_cst);
+
+	/* whoever makes us ready after this sees us waiting and posts */
+	if (!ready(mpmc)) {
+		do
+			r = epoll_wait(epoll, &event, 1, timeout);
+		while (r < 0 && errno == EINTR);
+
+		/* take the post, another waiter might have got it first */
+		if (r > 0 && read(fd, &value, sizeof(value)) < 0 && errno == EAGAIN)
+			errno = 0;
+	}
+
+	atomic_fetch_sub_explicit(waiting, 1, memory_order_relaxed);
+	return r < 0 ? -1 : 0;
+}
+
+/* if a producer could make something small now */
+int
+__whl_mpmc_any_room(whl_mpmc_t *mpmc)
+{
+	u64 head = atomic_load_explicit(&mpmc->head, memory_order_seq_cst);
+	u64 reserved = atomic_load_explicit(&mpmc->reserved, memory_order_seq_cst);
+
+	return reserved - head < mpmc->size;
+}
+
+/* a consumer calls this after `whl_mpmc_efd_next_shared_slice()` found
+ * nothing, it waits for a message up to `timeout` milliseconds, or forever if
+ * it's -1. only one waiter wakes for each message shared with
+ * `whl_mpmc_efd_share_slice()`. call `whl_mpmc_efd_next_shared_slice()` again
+ * after, another consumer might have got there first.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_mpmc_efd_wait_readable(whl_mpmc_efd_t *efd, int timeout)
+{
+	return __whl_mpmc_efd_wait(efd->mpmc, &efd->mpmc->readers_waiting,
+	                           efd->readable_epoll, efd->readable,
+	                           __whl_mpmc_any_shared, timeout);
+}
+
+/* a producer calls this after `whl_mpmc_make_slice()` failed, like
+ * `whl_mpmc_efd_wait_readable()`. it wakes for room given back by a consumer
+ * in `whl_mpmc_efd_next_shared_slice()` or `whl_mpmc_efd_return_slice()`,
+ * which might not be enough.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_mpmc_efd_wait_writable(whl_mpmc_efd_t *efd, int timeout)
+{
+	return __whl_mpmc_efd_wait(efd->mpmc, &efd->mpmc->writers_waiting,
+	                           efd->writable_epoll, efd->writable,
+	                           __whl_mpmc_any_room, timeout);
+}
@@ -0,0 +1,353 @@
+/* `whl_mpsc_t` is for many producers sending to one consumer over one ring,
+ * like worker processes reporting to an aggregator, instead of a wheel per
+ * producer each with its own memfd and eventfds for the consumer to poll.
+ *
+ * producers claim room by comparing and exchanging a reservation position
+ * that only increases, then write and share their messages in any order. the
+ * consumer reads them in the order they were claimed, stopping at the first
+ * one that isn't shared yet, and returns them in that order too.
+ *
+ * every message has an 8 byte header with its size and state and is 8 byte
+ * aligned. one that doesn't fit before the end of the ring goes at the start
+ * after a padding header. the consumer zeroes what it returns, so a header
+ * that's zero means nothing's been written there yet. without that, a
+ * producer that's slow to write its header could leave the consumer looking
+ * at whatever was written there on the last time around.
+ *
+ * `whl_mpsc_efd_t` polls like `whl_efd_t`, with the same readable and
+ * writable states in the `whl_mpsc_t` header. any producer can make it
+ * readable and any of them that finds the ring full makes it unwritable.
+ * include memorywheel.h before this.
+ *
+ * writers:
+ * - `whl_mpsc_make_slice()`
+ * - `whl_mpsc_share_slice()`
+ *
+ * reader:
+ * - `whl_mpsc_next_shared_slice()`
+ * - `whl_mpsc_return_slice()` */
+
+/* a line each for the size, the producers, the consumer, and the eventfd
+ * states */
+#define WHL_MPSC_HEADER_SIZE (4 * WHL_CACHE_LINE)
+#define WHL_MPSC_ALIGN       8
+
+/* the low two bits of a message's header, the size is shifted up over them */
+typedef enum {
+	/* zero, nothing's claimed this yet or it's still being claimed */
+	WHL_MPSC_EMPTY   = 0x0,
+	WHL_MPSC_WRITING = 0x1,
+	WHL_MPSC_SHARED  = 0x2,
+	/* nothing until the end of the ring, the next message is at the start */
+	WHL_MPSC_PADDING = 0x3,
+} whl_mpsc_state_e;
+
+/* lives in shared memory, the ring follows it */
+typedef struct {
+	/* the size of the ring in bytes, a multiple of WHL_MPSC_ALIGN,
+	 * read-only after `whl_mpsc_init()` */
+	u64         size;
+	/* written by the producers, the position after the last claimed */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 reserved;
+	/* written by the producers, what one of them last loaded from head */
+	_Atomic u64 producer_head;
+	/* written by the consumer, the position of the next message to read */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 head;
+	/* like in `whl_atomic_t`, written by all of them */
+	_Alignas(WHL_CACHE_LINE)
+	union {
+		struct {
+			_Atomic u8 readable_guard;
+			/* initially 0. set to 1 when a message is shared. */
+			_Atomic u8 is_readable;
+		};
+		_Atomic whl_u8_pair_t readable_state;
+	};
+	union {
+		struct {
+			_Atomic u8 writable_guard;
+			/* initially 1. set to 0 when making a message fails. */
+			_Atomic u8 is_writable;
+		};
+		_Atomic whl_u8_pair_t writable_state;
+	};
+} whl_mpsc_t;
+
+__whl_staticassert(whl_mpsc_t_sizeof, sizeof(whl_mpsc_t) <= WHL_MPSC_HEADER_SIZE);
+
+/* a copy for each process, like `whl_efd_t` */
+typedef struct {
+	whl_mpsc_t *mpsc;
+	int         readable;
+	int         writable;
+} whl_mpsc_efd_t;
+
+#define __whl_mpsc_at(mpsc, pos) \
+	((_Atomic u64 *)((byte *)(mpsc) + WHL_MPSC_HEADER_SIZE + (pos) % (mpsc)->size))
+#define __whl_mpsc_span(size) \
+	(sizeof(u64) + (((u64)(size) + WHL_MPSC_ALIGN - 1) & ~(u64)(WHL_MPSC_ALIGN - 1)))
+
+/* `mpsc` must point to allocated memory at least `buf_size` big, aligned to a
+ * cache line. this zeroes all of it.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_mpsc_init(whl_mpsc_t *mpsc, size_t buf_size)
+{
+	if (   buf_size < WHL_MPSC_HEADER_SIZE + 2 * WHL_MPSC_ALIGN
+	    || buf_size - WHL_MPSC_HEADER_SIZE > WHL_INVALID_OFFSET)
+		return -1;
+
+	memset(mpsc, 0, buf_size);
+
+	*mpsc = (whl_mpsc_t) {
+		.size = (buf_size - WHL_MPSC_HEADER_SIZE) & ~(u64)(WHL_MPSC_ALIGN - 1),
+		.reserved = 0,
+		.producer_head = 0,
+		.head = 0,
+		.is_readable = 0,
+		.is_writable = 1,
+	};
+	return 0;
+}
+
+/* any producer calls this, like `whl_make_slice()`.
+ *
+ * returns WHL_INVALID_OFFSET if there isn't room and *bufp is untouched */
+whl_offset_t
+whl_mpsc_make_slice(whl_mpsc_t *mpsc, byte **bufp, size_t size)
+{
+	u64 span = __whl_mpsc_span(size);
+	u64 pos = atomic_load_explicit(&mpsc->reserved, memory_order_relaxed);
+	u64 head;
+	u64 pad;
+
+	if (span > mpsc->size)
+		return WHL_INVALID_OFFSET;
+
+	for (;;) {
+		pad = 0;
+		if (span > mpsc->size - pos % mpsc->size)
+			pad = mpsc->size - pos % mpsc->size;
+
+		/* only look at the consumer's line if it looks like we're full,
+		 * the acquires pair with the consumer zeroing what it returned */
+		head = atomic_load_explicit(&mpsc->producer_head, memory_order_acquire);
+		if (pos + pad + span - head > mpsc->size) {
+			head = atomic_load_explicit(&mpsc->head, memory_order_acquire);
+			atomic_store_explicit(&mpsc->producer_head, head,
+			                      memory_order_release);
+		}
+
+		if (pos + pad + span - head > mpsc->size) {
+			/* the head can be past a position other producers already
+			 * claimed past, so only fail if nobody has */
+			u64 now = atomic_load_explicit(&mpsc->reserved,
+			                               memory_order_relaxed);
+			if (now == pos)
+				return WHL_INVALID_OFFSET;
+			pos = now;
+			continue;
+		}
+
+		if (atomic_compare_exchange_weak_explicit(&mpsc->reserved,
+		                                          &pos, pos + pad + span,
+		                                          memory_order_relaxed,
+		                                          memory_order_relaxed))
+			break;
+	}
+
+	if (pad) {
+		atomic_store_explicit(__whl_mpsc_at(mpsc, pos),
+		                      pad << 2 | WHL_MPSC_PADDING,
+		                      memory_order_release);
+		pos += pad;
+	}
+
+	/* keeps the size for sharing, the consumer waits on it till then */
+	atomic_store_explicit(__whl_mpsc_at(mpsc, pos),
+	                      (u64)size << 2 | WHL_MPSC_WRITING,
+	                      memory_order_relaxed);
+
+	*bufp = (byte *)(__whl_mpsc_at(mpsc, pos) + 1);
+	return pos % mpsc->size;
+}
+
+/* the producer that made the slice at `offset` calls this to let the
+ * consumer have it, once every slice claimed before it is shared too */
+void
+whl_mpsc_share_slice(whl_mpsc_t *mpsc, whl_offset_t offset)
+{
+	_Atomic u64 *header = __whl_mpsc_at(mpsc, offset);
+	u64          tag = atomic_load_explicit(header, memory_order_relaxed);
+
+	/* the release publishes the message */
+	atomic_store_explicit(header, (tag & ~(u64)0x3) | WHL_MPSC_SHARED,
+	                      memory_order_release);
+}
+
+/* gets the earliest claimed slice if it's shared, the same one until it's
+ * returned.
+ *
+ * returns WHL_INVALID_OFFSET if it's not shared or nothing's claimed */
+whl_offset_t
+whl_mpsc_next_shared_slice(whl_mpsc_t *mpsc, byte **bufp, size_t *size)
+{
+	/* we're the only one that writes head */
+	u64          head = atomic_load_explicit(&mpsc->head, memory_order_relaxed);
+	_Atomic u64 *header;
+	u64          tag;
+
+	for (;;) {
+		header = __whl_mpsc_at(mpsc, head);
+		tag = atomic_load_explicit(header, memory_order_acquire);
+
+		if ((tag & 0x3) != WHL_MPSC_PADDING)
+			break;
+
+		/* the rest of the padding is already zero */
+		atomic_store_explicit(header, 0, memory_order_relaxed);
+		head += tag >> 2;
+		atomic_store_explicit(&mpsc->head, head, memory_order_release);
+	}
+
+	if ((tag & 0x3) != WHL_MPSC_SHARED)
+		return WHL_INVALID_OFFSET;
+
+	*bufp = (byte *)(header + 1);
+	*size = tag >> 2;
+	return head % mpsc->size;
+}
+
+/* gives the slice from `whl_mpsc_next_shared_slice()` back to the producers,
+ * zeroing it first.
+ *
+ * returns the number of slices given back, 1 */
+size_t
+whl_mpsc_return_slice(whl_mpsc_t *mpsc, whl_offset_t offset)
+{
+	u64          head = atomic_load_explicit(&mpsc->head, memory_order_relaxed);
+	_Atomic u64 *header = __whl_mpsc_at(mpsc, offset);
+	u64          span = __whl_mpsc_span(atomic_load_explicit(header,
+	                                                         memory_order_relaxed) >> 2);
+
+	memset(header + 1, 0, span - sizeof(u64));
+	atomic_store_explicit(header, 0, memory_order_relaxed);
+	/* the release hands the zeroed room back to the producers */
+	atomic_store_explicit(&mpsc->head, head + span, memory_order_release);
+	return 1;
+}
+
+/* like `whl_efd_init_from_eventfds()` */
+void
+whl_mpsc_efd_init_from_eventfds(whl_mpsc_efd_t *efd, whl_mpsc_t *mpsc,
+                                int readable, int writable)
+{
+	*efd = (whl_mpsc_efd_t) {
+		.mpsc = mpsc,
+		.readable = readable,
+		.writable = writable,
+	};
+}
+
+/* like `whl_efd_init()` for an already initialized `whl_mpsc_t`
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_mpsc_efd_init(whl_mpsc_efd_t *efd, whl_mpsc_t *mpsc)
+{
+	int readable;
+	int writable;
+
+	if (__whl_efd_open(mpsc->is_readable, mpsc->is_writable,
+	                   &readable, &writable) < 0)
+		return -1;
+
+	whl_mpsc_efd_init_from_eventfds(efd, mpsc, readable, writable);
+	return 0;
+}
+
+/* closes the two eventfd file descriptors */
+void
+whl_mpsc_efd_close(whl_mpsc_efd_t *efd)
+{
+	close(efd->readable);
+	close(efd->writable);
+}
+
+/* like `whl_efd_fds()` */
+void
+whl_mpsc_efd_fds(whl_mpsc_efd_t *efd, int *readable, int *writable)
+{
+	*readable = efd->readable;
+	*writable = efd->writable;
+}
+
+/* `whl_mpsc_t` version of `whl_efd_make_slice()` */
+whl_offset_t
+whl_mpsc_efd_make_slice(whl_mpsc_efd_t *efd, byte **bufp, size_t size)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->mpsc->writable_guard, ~0);
+
+	whl_offset_t offset = whl_mpsc_make_slice(efd->mpsc, bufp, size);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unwritable(&efd->mpsc->writable_state, efd->writable);
+
+	return offset;
+}
+
+/* `whl_mpsc_t` version of `whl_efd_share_slice()` */
+void
+whl_mpsc_efd_share_slice(whl_mpsc_efd_t *efd, whl_offset_t offset)
+{
+	atomic_store(&efd->mpsc->readable_guard, 0);
+
+	whl_mpsc_share_slice(efd->mpsc, offset);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	__whl_efd_readable(&efd->mpsc->readable_state, efd->readable);
+}
+
+/* `whl_mpsc_t` version of `whl_efd_next_shared_slice()` */
+whl_offset_t
+whl_mpsc_efd_next_shared_slice(whl_mpsc_efd_t *efd, byte **bufp, size_t *size)
+{
+	atomic_store(&efd->mpsc->readable_guard, ~0);
+
+	whl_offset_t offset = whl_mpsc_next_shared_slice(efd->mpsc, bufp, size);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unreadable(&efd->mpsc->readable_state, efd->readable);
+
+	return offset;
+}
+
+/* `whl_mpsc_t` version of `whl_efd_return_slice()` */
+size_t
+whl_mpsc_efd_return_slice(whl_mpsc_efd_t *efd, whl_offset_t offset)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->mpsc->writable_guard, 0);
+
+	size_t r = whl_mpsc_return_slice(efd->mpsc, offset);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (r > 0)
+		__whl_efd_writable(&efd->mpsc->writable_state, efd->writable);
+
+	return r;
+}
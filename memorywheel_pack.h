@@ -0,0 +1,170 @@
+/* packs lots of small records into each slice of a memory wheel, so a tiny
+ * message doesn't cost a whole slice with its own header, state store and
+ * head advance.
+ *
+ * the producer appends records to the frame it has open, a slice from
+ * `whl_make_slice()`. each record is a length prefix followed by its bytes,
+ * the prefix is 1 byte for records under 128 bytes and 2 bytes for the rest up
+ * to WHL_PACK_RECORD_MAX. the frame is shrunk with `whl_commit_slice()` and
+ * shared when the next record doesn't fit or on `whl_pack_flush()`, so nothing
+ * is seen by the consumer until then. the consumer gets records one at a time
+ * out of each frame and returns the frame once it's read all of them.
+ *
+ * it's a `whl_t` underneath, initialized and shared like usual, and only
+ * `whl_pack_t` should make slices in it while a frame is open. include
+ * memorywheel.h before this.
+ *
+ * writer:
+ * - `whl_pack_record()` for each record
+ * - `whl_pack_flush()` when there's nothing else to send for a while
+ *
+ * reader:
+ * - `whl_unpack_next()` */
+
+#define WHL_PACK_RECORD_MAX 0x7fff
+
+#define __whl_pack_prefix_size(size) ((size) < 0x80 ? 1 : 2)
+
+/* the producer's, in non-shared memory */
+typedef struct {
+	whl_t       *wheel;
+	/* the size to make frames, a frame is only bigger for a record that
+	 * doesn't fit in this */
+	size_t       frame_size;
+	/* the open frame or WHL_INVALID_OFFSET */
+	whl_offset_t offset;
+	byte        *buf;
+	size_t       cap;
+	size_t       used;
+} whl_pack_t;
+
+/* the consumer's, in non-shared memory */
+typedef struct {
+	whl_t       *wheel;
+	/* the frame being read or WHL_INVALID_OFFSET */
+	whl_offset_t offset;
+	byte        *buf;
+	size_t       size;
+	size_t       pos;
+} whl_unpack_t;
+
+/* `frame_size` is how big to make each frame, it's a trade between wasting
+ * room in the wheel when flushing early and how many records go per slice.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_pack_init(whl_pack_t *pack, whl_t *wheel, size_t frame_size)
+{
+	if (frame_size < 2)
+		return -1;
+
+	*pack = (whl_pack_t) {
+		.wheel = wheel,
+		.frame_size = frame_size,
+		.offset = WHL_INVALID_OFFSET,
+	};
+	return 0;
+}
+
+/* shares the open frame, if any, with only as much of the wheel as its
+ * records take up */
+void
+whl_pack_flush(whl_pack_t *pack)
+{
+	if (pack->offset == WHL_INVALID_OFFSET)
+		return;
+
+	whl_commit_slice(pack->wheel, pack->offset, pack->used);
+	whl_share_slice(pack->wheel, pack->offset);
+	pack->offset = WHL_INVALID_OFFSET;
+}
+
+/* appends a record of `size` bytes to the open frame, sharing it and making
+ * a new one if it doesn't fit. write the record to *bufp before the frame is
+ * shared by the next call or `whl_pack_flush()`.
+ *
+ * returns non-zero if `size` is more than WHL_PACK_RECORD_MAX or there's no
+ * room in the wheel for a new frame, then *bufp is untouched and any frame
+ * that was open is shared */
+int
+whl_pack_record(whl_pack_t *pack, byte **bufp, size_t size)
+{
+	size_t prefix = __whl_pack_prefix_size(size);
+	byte  *record;
+
+	if (size > WHL_PACK_RECORD_MAX)
+		return -1;
+
+	if (   pack->offset != WHL_INVALID_OFFSET
+	    && prefix + size > pack->cap - pack->used)
+		whl_pack_flush(pack);
+
+	if (pack->offset == WHL_INVALID_OFFSET) {
+		size_t cap = pack->frame_size;
+		if (cap < prefix + size)
+			cap = prefix + size;
+		pack->offset = whl_make_slice(pack->wheel, &pack->buf, cap);
+		if (pack->offset == WHL_INVALID_OFFSET)
+			return -1;
+		pack->cap = cap;
+		pack->used = 0;
+	}
+
+	record = pack->buf + pack->used;
+	if (prefix == 1) {
+		record[0] = size;
+	} else {
+		record[0] = 0x80 | (size >> 8);
+		record[1] = size & 0xff;
+	}
+
+	pack->used += prefix + size;
+	*bufp = record + prefix;
+	return 0;
+}
+
+void
+whl_unpack_init(whl_unpack_t *unpack, whl_t *wheel)
+{
+	*unpack = (whl_unpack_t) {
+		.wheel = wheel,
+		.offset = WHL_INVALID_OFFSET,
+	};
+}
+
+/* gets the next record, returning the frame it was in once it's read past the
+ * end of it. the record in *bufp is good until the next call.
+ *
+ * returns non-zero if there's no record shared */
+int
+whl_unpack_next(whl_unpack_t *unpack, byte **bufp, size_t *size)
+{
+	byte *record;
+
+	if (   unpack->offset != WHL_INVALID_OFFSET
+	    && unpack->pos == unpack->size) {
+		whl_return_slice(unpack->wheel, unpack->offset);
+		unpack->offset = WHL_INVALID_OFFSET;
+	}
+
+	/* frames always have at least one record */
+	if (unpack->offset == WHL_INVALID_OFFSET) {
+		unpack->offset = whl_next_shared_slice(unpack->wheel, &unpack->buf,
+		                                       &unpack->size);
+		if (unpack->offset == WHL_INVALID_OFFSET)
+			return -1;
+		unpack->pos = 0;
+	}
+
+	record = unpack->buf + unpack->pos;
+	if (record[0] & 0x80) {
+		*size = (size_t)(record[0] & 0x7f) << 8 | record[1];
+		*bufp = record + 2;
+	} else {
+		*size = record[0];
+		*bufp = record + 1;
+	}
+
+	unpack->pos = *bufp + *size - unpack->buf;
+	return 0;
+}
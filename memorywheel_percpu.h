@@ -0,0 +1,219 @@
+/* `whl_percpu_t` is for threads in one process sending to one consumer
+ * without fighting over a shared position like in `whl_mpsc_t`. one shared
+ * memory holds a `whl_t` for each cpu, a producer thread makes and shares its
+ * message in the wheel for the cpu it's running on, and the consumer reads
+ * from all of them. messages are in order for each wheel but not between
+ * them, `whl_percpu_stamp()` gives out numbers to put in messages for a
+ * consumer that wants to put them back in order.
+ *
+ * the cpu comes from the rseq area glibc registers for each thread, that's a
+ * load instead of a syscall. without it, it's `sched_getcpu()`, define
+ * _GNU_SOURCE for that.
+ *
+ * each wheel is only for one producer at a time, but a thread can be moved to
+ * another cpu or have another thread on its cpu run before it shares. so a
+ * producer takes a flag for the wheel between making and sharing, and goes on
+ * to the next wheel if it's taken. taking it is an exchange, usually an
+ * uncontended one on a line that stays in that cpu's cache, but a thread that
+ * moved cpus, went on to the next wheel, or is on a cpu numbered past `count`
+ * writes another cpu's line. an rseq critical section would get rid of the
+ * exchange but needs assembly for each architecture.
+ *
+ * the `whl_percpu_t` header comes first in the shared memory, then the
+ * wheels. include memorywheel.h before this.
+ *
+ * writers:
+ * - `whl_percpu_make_slice()`
+ * - `whl_percpu_share_slice()`
+ *
+ * reader:
+ * - `whl_percpu_next_shared_slice()`
+ * - `whl_percpu_return_slice()` */
+#include <sched.h>
+/* glibc 2.35 and up registers rseq, finding its area needs the thread
+ * pointer */
+#if defined(__has_include) && defined(__has_builtin)
+#if __has_include(<sys/rseq.h>) && __has_builtin(__builtin_thread_pointer)
+#include <sys/rseq.h>
+#define WHL_PERCPU_RSEQ
+#endif
+#endif
+
+/* the most wheels, cpus past this share wheels with the ones before */
+#define WHL_PERCPU_MAX         64
+/* a line each for the sizes, the consumer, and the stamps, then each wheel's
+ * flag */
+#define WHL_PERCPU_HEADER_SIZE ((3 + WHL_PERCPU_MAX) * WHL_CACHE_LINE)
+
+/* lives in shared memory, the wheels follow it */
+typedef struct {
+	/* how many wheels, read-only after `whl_percpu_init()` */
+	u32         count;
+	/* the size of each wheel, a multiple of WHL_CACHE_LINE, read-only
+	 * after `whl_percpu_init()` */
+	u64         wheel_size;
+	/* written by the consumer, the wheel it looks at first next time */
+	_Alignas(WHL_CACHE_LINE)
+	u32         next;
+	/* see `whl_percpu_stamp()` */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 stamp;
+	/* written by the producers, set while one's between making and sharing
+	 * in that wheel */
+	struct {
+		_Alignas(WHL_CACHE_LINE)
+		_Atomic u8 busy;
+	}           flags[WHL_PERCPU_MAX];
+} whl_percpu_t;
+
+__whl_staticassert(whl_percpu_t_sizeof, sizeof(whl_percpu_t) <= WHL_PERCPU_HEADER_SIZE);
+
+/* the wheel numbered `n` */
+#define whl_percpu_wheel(percpu, n) \
+	((whl_t *)((byte *)(percpu) + WHL_PERCPU_HEADER_SIZE + (n) * (percpu)->wheel_size))
+
+/* the cpu this thread's on, or was a moment ago */
+u32
+__whl_percpu_cpu(void)
+{
+	int cpu;
+
+#ifdef WHL_PERCPU_RSEQ
+	/* the kernel keeps cpu_id up to date in the area glibc registered */
+	if (__rseq_size > 0) {
+		struct rseq *rseq = (struct rseq *)((byte *)__builtin_thread_pointer()
+		                                    + __rseq_offset);
+		return *(volatile u32 *)&rseq->cpu_id;
+	}
+#endif
+
+	cpu = sched_getcpu();
+	return cpu < 0 ? 0 : cpu;
+}
+
+/* `percpu` must point to allocated memory at least `buf_size` big, aligned to
+ * a cache line. it's split into `count` wheels, no more than WHL_PERCPU_MAX,
+ * each made with `whl_init_aligned()`. probably one for each cpu from
+ * `sysconf(_SC_NPROCESSORS_CONF)`.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_percpu_init_aligned(whl_percpu_t *percpu, size_t buf_size, u32 count,
+                        size_t align)
+{
+	if (   count == 0
+	    || count > WHL_PERCPU_MAX
+	    || buf_size < WHL_PERCPU_HEADER_SIZE)
+		return -1;
+
+	*percpu = (whl_percpu_t) {
+		.count = count,
+		.wheel_size = (buf_size - WHL_PERCPU_HEADER_SIZE) / count
+		              & ~(u64)(WHL_CACHE_LINE - 1),
+		.next = 0,
+		.stamp = 0,
+	};
+
+	for (u32 n = 0; n < count; n++) {
+		atomic_init(&percpu->flags[n].busy, 0);
+		if (whl_init_aligned(whl_percpu_wheel(percpu, n),
+		                     percpu->wheel_size, align) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int
+whl_percpu_init(whl_percpu_t *percpu, size_t buf_size, u32 count)
+{
+	return whl_percpu_init_aligned(percpu, buf_size, count, WHL_ALIGN);
+}
+
+/* any producer thread calls this. like `whl_make_slice()` in the wheel for
+ * the cpu it's on, or the next one not in use by another thread. puts the
+ * wheel's number in *wheel for `whl_percpu_share_slice()`, which has to be
+ * called before this thread makes another.
+ *
+ * returns WHL_INVALID_OFFSET if that wheel is full or all of them are in use,
+ * *bufp is untouched */
+whl_offset_t
+whl_percpu_make_slice(whl_percpu_t *percpu, u32 *wheel, byte **bufp,
+                      size_t size)
+{
+	u32          cpu = __whl_percpu_cpu();
+	whl_offset_t offset;
+
+	for (u32 i = 0; i < percpu->count; i++) {
+		u32 n = (cpu + i) % percpu->count;
+
+		/* pairs with the release in `whl_percpu_share_slice()` so we
+		 * see what the last thread in this wheel did */
+		if (atomic_exchange_explicit(&percpu->flags[n].busy, 1,
+		                             memory_order_acquire))
+			continue;
+
+		offset = whl_make_slice(whl_percpu_wheel(percpu, n), bufp, size);
+		if (offset == WHL_INVALID_OFFSET) {
+			atomic_store_explicit(&percpu->flags[n].busy, 0,
+			                      memory_order_release);
+			return WHL_INVALID_OFFSET;
+		}
+
+		*wheel = n;
+		return offset;
+	}
+
+	return WHL_INVALID_OFFSET;
+}
+
+/* the thread that made the slice shares it and lets other threads have the
+ * wheel */
+void
+whl_percpu_share_slice(whl_percpu_t *percpu, u32 wheel, whl_offset_t offset)
+{
+	whl_share_slice(whl_percpu_wheel(percpu, wheel), offset);
+	atomic_store_explicit(&percpu->flags[wheel].busy, 0, memory_order_release);
+}
+
+/* optional, a number that only increases across all the wheels to put in a
+ * message so the consumer can order messages from different wheels. this
+ * one's shared by every producer, so it costs what `whl_percpu_t` avoids. */
+u64
+whl_percpu_stamp(whl_percpu_t *percpu)
+{
+	return atomic_fetch_add_explicit(&percpu->stamp, 1, memory_order_relaxed);
+}
+
+/* like `whl_next_shared_slice()`, looking at each wheel starting after the one
+ * it last got something from, so a busy one doesn't starve the rest. puts the
+ * wheel's number in *wheel for `whl_percpu_return_slice()`.
+ *
+ * returns WHL_INVALID_OFFSET if no wheel has anything shared */
+whl_offset_t
+whl_percpu_next_shared_slice(whl_percpu_t *percpu, u32 *wheel, byte **bufp,
+                             size_t *size)
+{
+	whl_offset_t offset;
+
+	for (u32 i = 0; i < percpu->count; i++) {
+		u32 n = (percpu->next + i) % percpu->count;
+
+		offset = whl_next_shared_slice(whl_percpu_wheel(percpu, n),
+		                               bufp, size);
+		if (offset != WHL_INVALID_OFFSET) {
+			percpu->next = (n + 1) % percpu->count;
+			*wheel = n;
+			return offset;
+		}
+	}
+
+	return WHL_INVALID_OFFSET;
+}
+
+/* like `whl_return_slice()` */
+size_t
+whl_percpu_return_slice(whl_percpu_t *percpu, u32 wheel, whl_offset_t offset)
+{
+	return whl_return_slice(whl_percpu_wheel(percpu, wheel), offset);
+}
@@ -0,0 +1,178 @@
+/* a pool of worker threads on the consuming end of one wheel. a dispatcher
+ * thread gets each shared slice in order and hands it to a worker, workers
+ * return their slices whenever they're done, in any order. the wheel's head
+ * only moves over slices that are returned with nothing before them still out,
+ * so one slow worker holds back the room from everything returned after its
+ * slice. `whl_pool_stats()` says how much.
+ *
+ * the producer doesn't know about any of this, it's a `whl_t` made and shared
+ * like usual. the `whl_pool_t` lives in the consuming process's memory, not
+ * the shared memory. don't get slices from the wheel other than through the
+ * pool, and the producer shouldn't `whl_abort_slice()`. include memorywheel.h
+ * before this.
+ *
+ * with WHL_SPLIT, returning and starting over from the head use the
+ * consumer's view of the wheel, so the pool takes a lock around those. the
+ * default engine doesn't need it, `whl_return_slice()` is safe from a few
+ * threads at once.
+ *
+ * dispatcher:
+ * - `whl_pool_next_shared_slice()`, the next slice after the last it got
+ *
+ * workers:
+ * - `whl_pool_return_slice()` */
+
+/* see `whl_pool_stats()` */
+typedef struct {
+	/* slices the dispatcher got */
+	u64 dispatched;
+	/* slices the workers returned */
+	u64 returned;
+	/* returns that didn't give any room back, because a slice before was
+	 * still out */
+	u64 waited;
+	/* the most returned slices waiting on a slice before them at once */
+	u64 peak_waiting;
+} whl_pool_stats_t;
+
+/* in non-shared memory */
+typedef struct {
+	whl_t          *wheel;
+	/* the dispatcher's */
+	whl_iter_t      iter;
+	/* written by the dispatcher and the workers, slices got and not
+	 * returned yet. while it's not zero, the head can't move past the last
+	 * slice the dispatcher got so the iteration is good */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64     out;
+	/* returned slices the head hasn't moved over yet */
+	_Atomic int64_t waiting;
+	_Atomic u64     returned;
+	_Atomic u64     waited;
+	_Atomic u64     peak_waiting;
+#ifdef WHL_SPLIT
+	atomic_flag     lock;
+#endif
+	/* the dispatcher's */
+	_Alignas(WHL_CACHE_LINE)
+	u64             dispatched;
+} whl_pool_t;
+
+#ifdef WHL_SPLIT
+#define __whl_pool_lock(pool) \
+	while (atomic_flag_test_and_set_explicit(&(pool)->lock, memory_order_acquire))
+#define __whl_pool_unlock(pool) \
+	atomic_flag_clear_explicit(&(pool)->lock, memory_order_release)
+#else
+#define __whl_pool_lock(pool)
+#define __whl_pool_unlock(pool)
+#endif
+
+/* `wheel` is initialized and nothing's been got from it yet */
+void
+whl_pool_init(whl_pool_t *pool, whl_t *wheel)
+{
+	*pool = (whl_pool_t) {
+		.wheel = wheel,
+		.out = 0,
+		.waiting = 0,
+		.returned = 0,
+		.waited = 0,
+		.peak_waiting = 0,
+#ifdef WHL_SPLIT
+		.lock = ATOMIC_FLAG_INIT,
+#endif
+	};
+	whl_iter_shared_slices(wheel, &pool->iter);
+}
+
+/* starts over from the head, once everything got is returned */
+void
+__whl_pool_restart(whl_pool_t *pool)
+{
+	__whl_pool_lock(pool);
+	whl_iter_shared_slices(pool->wheel, &pool->iter);
+	__whl_pool_unlock(pool);
+}
+
+/* only the dispatcher calls this, or one thread at a time. gets the next
+ * shared slice after the last one it got, whether or not that's returned yet,
+ * for handing to a worker.
+ *
+ * returns WHL_INVALID_OFFSET if there isn't one shared yet */
+whl_offset_t
+whl_pool_next_shared_slice(whl_pool_t *pool, byte **bufp, size_t *size)
+{
+	u64          out = atomic_load(&pool->out);
+	whl_offset_t offset;
+
+	if (out == 0)
+		__whl_pool_restart(pool);
+	else
+		whl_iter_more(pool->wheel, &pool->iter);
+
+	offset = whl_iter_next(pool->wheel, &pool->iter, bufp, size);
+
+	/* the workers returned everything while we were looking, so what we
+	 * looked at might be reused already. only we add to out, so now that
+	 * it's zero it stays zero */
+	if (out != 0 && atomic_load(&pool->out) == 0) {
+		__whl_pool_restart(pool);
+		offset = whl_iter_next(pool->wheel, &pool->iter, bufp, size);
+	}
+
+	if (offset == WHL_INVALID_OFFSET)
+		return WHL_INVALID_OFFSET;
+
+	atomic_fetch_add(&pool->out, 1);
+	pool->dispatched++;
+	return offset;
+}
+
+/* any worker calls this with a slice the dispatcher got, in any order.
+ *
+ * returns the number of slices the head moved over, 0 if this one waits on
+ * one before it */
+size_t
+whl_pool_return_slice(whl_pool_t *pool, whl_offset_t offset)
+{
+	size_t  r;
+	int64_t waiting;
+	u64     peak;
+
+	__whl_pool_lock(pool);
+	r = whl_return_slice(pool->wheel, offset);
+	__whl_pool_unlock(pool);
+
+	/* counted before `out` so the dispatcher doesn't start over before the
+	 * head moved */
+	atomic_fetch_add_explicit(&pool->returned, 1, memory_order_relaxed);
+	if (r == 0)
+		atomic_fetch_add_explicit(&pool->waited, 1, memory_order_relaxed);
+
+	waiting = atomic_fetch_add_explicit(&pool->waiting, 1 - (int64_t)r,
+	                                    memory_order_relaxed) + 1 - (int64_t)r;
+	peak = atomic_load_explicit(&pool->peak_waiting, memory_order_relaxed);
+	while (   waiting > 0
+	       && (u64)waiting > peak
+	       && !atomic_compare_exchange_weak_explicit(&pool->peak_waiting,
+	                                                 &peak, waiting,
+	                                                 memory_order_relaxed,
+	                                                 memory_order_relaxed));
+
+	atomic_fetch_sub(&pool->out, 1);
+	return r;
+}
+
+/* the counts so far, `dispatched` is only right from the dispatcher */
+whl_pool_stats_t
+whl_pool_stats(whl_pool_t *pool)
+{
+	return (whl_pool_stats_t) {
+		.dispatched = pool->dispatched,
+		.returned = atomic_load_explicit(&pool->returned, memory_order_relaxed),
+		.waited = atomic_load_explicit(&pool->waited, memory_order_relaxed),
+		.peak_waiting = atomic_load_explicit(&pool->peak_waiting,
+		                                     memory_order_relaxed),
+	};
+}
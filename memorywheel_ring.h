@@ -0,0 +1,238 @@
+/* `whl_ring_t` keeps the slices' headers apart from their contents. there's a
+ * ring of fixed size descriptors, each with where its payload is, its size and
+ * its state, then an arena for the payloads where every payload starts on its
+ * own cache line.
+ *
+ * so payloads are aligned for wide loads and stores, the consumer finds the
+ * next message by looking at descriptors only, and neither end writes to a
+ * line the other end writes. the consumer never writes to descriptors or
+ * payloads, returning a slice only stores its position on its own line.
+ *
+ * the cost is that every payload takes up whole cache lines, which wastes more
+ * than `whl_t` for small messages, and the number of slices at once is limited
+ * by the number of descriptors.
+ *
+ * like `whl_split_t` positions only increase and each end keeps what it last
+ * saw of the other on its own line, only loading the other's when the ring
+ * looks full or empty. it's single-producer single-consumer. include
+ * memorywheel.h before this.
+ *
+ * writer:
+ * - `whl_ring_make_slice()`
+ * - `whl_ring_share_slice()`
+ *
+ * reader:
+ * - `whl_ring_next_shared_slice()`
+ * - `whl_ring_return_slice()`, in the same order */
+
+/* a line for the sizes, the producer, the consumer, and one spare */
+#define WHL_RING_HEADER_SIZE (4 * WHL_CACHE_LINE)
+
+/* lives in shared memory after the `whl_ring_t` header */
+typedef struct {
+	/* the position in the arena of the payload */
+	u64         pos;
+	/* the size in bytes the user requested */
+	u32         size;
+	/* WHL_SLICE_UNINIT once made and WHL_SLICE_READABLE once shared */
+	_Atomic u32 state;
+} whl_desc_t;
+
+/* what one end of a `whl_ring_t` keeps to itself, counts of descriptors and
+ * positions in the arena */
+typedef struct {
+	/* the producer's descriptors made, ahead of tail by the ones made and not
+	 * shared */
+	u64 reserved;
+	/* the producer's is what it last stored to ring->tail,
+	 * the consumer's is what it last loaded */
+	u64 tail;
+	/* the consumer's is what it last stored to ring->head,
+	 * the producer's is what it last loaded */
+	u64 head;
+	/* the producer's arena position after the most recently made payload */
+	u64 arena_reserved;
+	/* like head but for ring->arena_head */
+	u64 arena_head;
+} whl_ring_view_t;
+
+/* lives in shared memory */
+typedef struct {
+	/* the number of descriptors, a power of two,
+	 * read-only after `whl_ring_init()` */
+	u64             slots;
+	/* the size of the payload arena in bytes, a multiple of WHL_CACHE_LINE,
+	 * read-only after `whl_ring_init()` */
+	u64             arena_size;
+	/* how far the arena is after the start of this */
+	u64             arena_offset;
+	/* written by the producer,
+	 * the number of descriptors up to the most recent shared one */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64     tail;
+	whl_ring_view_t producer;
+	/* written by the consumer,
+	 * the number of descriptors returned and the arena position up to the
+	 * end of their payloads */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64     head;
+	_Atomic u64     arena_head;
+	whl_ring_view_t consumer;
+} whl_ring_t;
+
+__whl_staticassert(whl_ring_t_sizeof, sizeof(whl_ring_t) <= WHL_RING_HEADER_SIZE);
+__whl_staticassert(whl_desc_t_sizeof, sizeof(whl_desc_t) == 16);
+
+#define __whl_ring_desc(ring, n) \
+	((whl_desc_t *)((byte *)(ring) + WHL_RING_HEADER_SIZE) \
+	 + (n) % (ring)->slots)
+#define __whl_ring_payload(ring, pos) \
+	((byte *)(ring) + (ring)->arena_offset + (pos) % (ring)->arena_size)
+#define __whl_ring_span(size) \
+	(((u64)(size) + WHL_CACHE_LINE - 1) & ~(u64)(WHL_CACHE_LINE - 1))
+
+/* `ring` must point to allocated memory at least `buf_size` big, aligned to a
+ * cache line. `slots` is the number of descriptors, a power of two of at least
+ * 4, the arena is what's left after them.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_ring_init(whl_ring_t *ring, size_t buf_size, size_t slots)
+{
+	u64 arena_offset = WHL_RING_HEADER_SIZE + slots * sizeof(whl_desc_t);
+
+	if (   slots < WHL_CACHE_LINE / sizeof(whl_desc_t)
+	    || slots > WHL_INVALID_OFFSET
+	    || (slots & (slots - 1)) != 0
+	    || buf_size < arena_offset + WHL_CACHE_LINE)
+		return -1;
+
+	*ring = (whl_ring_t) {
+		.slots = slots,
+		.arena_size = (buf_size - arena_offset) & ~(u64)(WHL_CACHE_LINE - 1),
+		.arena_offset = arena_offset,
+		.tail = 0,
+		.head = 0,
+		.arena_head = 0,
+	};
+	return 0;
+}
+
+/* finds room for a descriptor and a payload of `size` bytes.
+ *
+ * returns WHL_INVALID_OFFSET if there's no room and *bufp is untouched */
+whl_offset_t
+whl_ring_make_slice(whl_ring_t *ring, byte **bufp, size_t size)
+{
+	whl_ring_view_t *view = &ring->producer;
+	u64              span = __whl_ring_span(size);
+	u64              pos = view->arena_reserved;
+	u64              off = pos % ring->arena_size;
+
+	if (span > ring->arena_size || size > UINT32_MAX)
+		return WHL_INVALID_OFFSET;
+
+	/* payloads don't wrap, skip the rest of the arena */
+	if (span > ring->arena_size - off)
+		pos += ring->arena_size - off;
+
+	/* only look at the consumer's line if it looks like we're full */
+	if (   view->reserved - view->head == ring->slots
+	    || pos + span - view->arena_head > ring->arena_size) {
+		view->head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		view->arena_head = atomic_load_explicit(&ring->arena_head,
+		                                        memory_order_acquire);
+		if (   view->reserved - view->head == ring->slots
+		    || pos + span - view->arena_head > ring->arena_size)
+			return WHL_INVALID_OFFSET;
+	}
+
+	whl_desc_t *desc = __whl_ring_desc(ring, view->reserved);
+	desc->pos = pos;
+	desc->size = size;
+	atomic_store_explicit(&desc->state, WHL_SLICE_UNINIT, memory_order_relaxed);
+
+	view->reserved++;
+	view->arena_reserved = pos + span;
+
+	*bufp = __whl_ring_payload(ring, pos);
+	return (view->reserved - 1) % ring->slots;
+}
+
+/* called after `whl_ring_make_slice()` to let the consumer have the slice */
+void
+whl_ring_share_slice(whl_ring_t *ring, whl_offset_t offset)
+{
+	whl_ring_view_t *view = &ring->producer;
+	/* how far back from the most recently made descriptor this one is */
+	u64              back = ((view->reserved - 1) % ring->slots
+	                         + ring->slots - offset) % ring->slots;
+	u64              end = view->reserved - back;
+	whl_desc_t      *desc = __whl_ring_desc(ring, offset);
+
+	if (end > view->tail) {
+		/* the release on tail publishes the state too */
+		atomic_store_explicit(&desc->state, WHL_SLICE_READABLE,
+		                      memory_order_relaxed);
+		atomic_store_explicit(&ring->tail, end, memory_order_release);
+		view->tail = end;
+	} else {
+		/* an earlier slice than one already shared */
+		atomic_store_explicit(&desc->state, WHL_SLICE_READABLE,
+		                      memory_order_release);
+	}
+}
+
+/* whether the consumer has anything between its head and tail, only loads the
+ * producer's tail if it doesn't */
+int
+__whl_ring_any(whl_ring_t *ring, whl_ring_view_t *view)
+{
+	if (view->head == view->tail)
+		view->tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	return view->head != view->tail;
+}
+
+/* gets the earliest shared slice, like `whl_next_shared_slice()`.
+ *
+ * returns WHL_INVALID_OFFSET if it's not shared yet */
+whl_offset_t
+whl_ring_next_shared_slice(whl_ring_t *ring, byte **bufp, size_t *size)
+{
+	whl_ring_view_t *view = &ring->consumer;
+
+	if (!__whl_ring_any(ring, view))
+		return WHL_INVALID_OFFSET;
+
+	whl_desc_t *desc = __whl_ring_desc(ring, view->head);
+
+	if (atomic_load_explicit(&desc->state, memory_order_acquire)
+	    != WHL_SLICE_READABLE)
+		return WHL_INVALID_OFFSET;
+
+	*bufp = __whl_ring_payload(ring, desc->pos);
+	*size = desc->size;
+	return view->head % ring->slots;
+}
+
+/* gives the slice from `whl_ring_next_shared_slice()` back to the producer,
+ * slices are returned in the order they're got.
+ *
+ * returns the number of slices given back, 1 */
+size_t
+whl_ring_return_slice(whl_ring_t *ring, whl_offset_t offset)
+{
+	whl_ring_view_t *view = &ring->consumer;
+	whl_desc_t      *desc = __whl_ring_desc(ring, offset);
+
+	view->head++;
+	view->arena_head = desc->pos + __whl_ring_span(desc->size);
+
+	/* the release hands the payload back to the producer after we're done
+	 * reading it */
+	atomic_store_explicit(&ring->arena_head, view->arena_head,
+	                      memory_order_release);
+	atomic_store_explicit(&ring->head, view->head, memory_order_release);
+
+	return 1;
+}
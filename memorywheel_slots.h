@@ -0,0 +1,297 @@
+/* `whl_slots_t` is a ring of fixed size slots for channels that only carry
+ * one type of message, so none of what `whl_t` does for variable sizes is
+ * needed. there's no header per slot, no padding or backfilling and no
+ * wrapping checks, a slot is found by masking a position with the number of
+ * slots, a power of two. slots are packed back to back with no alignment
+ * beyond the size, so four 16 byte slots share a cache line.
+ *
+ * like `whl_split_t` positions only increase and each end keeps what it last
+ * saw of the other on its own line, only loading the other's when it looks
+ * full or empty. it's single-producer single-consumer and slots are shared
+ * and returned in the order they're made. include memorywheel.h before this.
+ *
+ * `whl_slots_efd_t` polls like `whl_efd_t`, with the same readable and
+ * writable states in the `whl_slots_t` header.
+ *
+ * writer:
+ * - `whl_slots_make_slot()`
+ * - `whl_slots_share_slot()`
+ *
+ * reader:
+ * - `whl_slots_next_shared_slot()`
+ * - `whl_slots_return_slot()` */
+
+/* a line each for the sizes, the producer, the consumer, and the eventfd
+ * states */
+#define WHL_SLOTS_HEADER_SIZE (4 * WHL_CACHE_LINE)
+
+/* lives in shared memory, the slots follow it */
+typedef struct {
+	/* the size in bytes of a slot, read-only after `whl_slots_init()` */
+	u64 size;
+	/* the number of slots minus one, the number is a power of two,
+	 * read-only after `whl_slots_init()` */
+	u64 mask;
+	/* written by the producer, the number of slots shared */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 tail;
+	/* the producer's, the number of slots made */
+	u64         reserved;
+	/* the producer's, what it last loaded from head */
+	u64         producer_head;
+	/* written by the consumer, the number of slots returned */
+	_Alignas(WHL_CACHE_LINE)
+	_Atomic u64 head;
+	/* the consumer's, what it last loaded from tail */
+	u64         consumer_tail;
+	/* like in `whl_atomic_t`, written by both */
+	_Alignas(WHL_CACHE_LINE)
+	union {
+		struct {
+			_Atomic u8 readable_guard;
+			/* initially 0. set to 1 when a slot is shared. */
+			_Atomic u8 is_readable;
+		};
+		_Atomic whl_u8_pair_t readable_state;
+	};
+	union {
+		struct {
+			_Atomic u8 writable_guard;
+			/* initially 1. set to 0 when making a slot fails. */
+			_Atomic u8 is_writable;
+		};
+		_Atomic whl_u8_pair_t writable_state;
+	};
+} whl_slots_t;
+
+__whl_staticassert(whl_slots_t_sizeof, sizeof(whl_slots_t) <= WHL_SLOTS_HEADER_SIZE);
+
+/* a copy for each process, like `whl_efd_t` */
+typedef struct {
+	whl_slots_t *slots;
+	int          readable;
+	int          writable;
+} whl_slots_efd_t;
+
+#define __whl_slots_at(slots, n) \
+	((byte *)(slots) + WHL_SLOTS_HEADER_SIZE + ((n) & (slots)->mask) * (slots)->size)
+
+/* `slots` must point to allocated memory at least `buf_size` big, aligned to a
+ * cache line. there are `count` slots of `size` bytes each, `count` is a power
+ * of two.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_slots_init(whl_slots_t *slots, size_t buf_size, size_t size, size_t count)
+{
+	if (   size == 0
+	    || count == 0
+	    || count > WHL_INVALID_OFFSET
+	    || (count & (count - 1)) != 0
+	    || buf_size < WHL_SLOTS_HEADER_SIZE
+	    || size > (buf_size - WHL_SLOTS_HEADER_SIZE) / count)
+		return -1;
+
+	*slots = (whl_slots_t) {
+		.size = size,
+		.mask = count - 1,
+		.is_readable = 0,
+		.is_writable = 1,
+		.tail = 0,
+		.head = 0,
+	};
+	return 0;
+}
+
+/* the number of slots that fit in `buf_size` bytes after the header, rounded
+ * down to a power of two, for passing to `whl_slots_init()` */
+size_t
+whl_slots_count(size_t buf_size, size_t size)
+{
+	size_t n;
+	size_t count = 1;
+
+	if (size == 0 || buf_size < WHL_SLOTS_HEADER_SIZE + size)
+		return 0;
+
+	n = (buf_size - WHL_SLOTS_HEADER_SIZE) / size;
+	while (count <= n / 2)
+		count *= 2;
+	return count;
+}
+
+/* gets the next slot to write to.
+ *
+ * returns WHL_INVALID_OFFSET if every slot is in use and *bufp is untouched */
+whl_offset_t
+whl_slots_make_slot(whl_slots_t *slots, byte **bufp)
+{
+	/* only look at the consumer's line if it looks like we're full */
+	if (slots->reserved - slots->producer_head > slots->mask) {
+		slots->producer_head = atomic_load_explicit(&slots->head,
+		                                            memory_order_acquire);
+		if (slots->reserved - slots->producer_head > slots->mask)
+			return WHL_INVALID_OFFSET;
+	}
+
+	*bufp = __whl_slots_at(slots, slots->reserved);
+	return slots->reserved++ & slots->mask;
+}
+
+/* called after `whl_slots_make_slot()` to let the consumer have the slot,
+ * slots are shared in the order they're made so `offset` is only for
+ * symmetry with `whl_share_slice()` */
+void
+whl_slots_share_slot(whl_slots_t *slots, whl_offset_t offset)
+{
+	u64 tail = atomic_load_explicit(&slots->tail, memory_order_relaxed);
+
+	(void)offset;
+	atomic_store_explicit(&slots->tail, tail + 1, memory_order_release);
+}
+
+/* gets the earliest shared slot, the same one until it's returned.
+ *
+ * returns WHL_INVALID_OFFSET if nothing is shared */
+whl_offset_t
+whl_slots_next_shared_slot(whl_slots_t *slots, byte **bufp)
+{
+	u64 head = atomic_load_explicit(&slots->head, memory_order_relaxed);
+
+	/* only look at the producer's line if it looks like we're empty */
+	if (head == slots->consumer_tail) {
+		slots->consumer_tail = atomic_load_explicit(&slots->tail,
+		                                            memory_order_acquire);
+		if (head == slots->consumer_tail)
+			return WHL_INVALID_OFFSET;
+	}
+
+	*bufp = __whl_slots_at(slots, head);
+	return head & slots->mask;
+}
+
+/* gives the slot from `whl_slots_next_shared_slot()` back to the producer.
+ *
+ * returns the number of slots given back, 1 */
+size_t
+whl_slots_return_slot(whl_slots_t *slots, whl_offset_t offset)
+{
+	u64 head = atomic_load_explicit(&slots->head, memory_order_relaxed);
+
+	(void)offset;
+	/* the release hands the slot back after we're done reading it */
+	atomic_store_explicit(&slots->head, head + 1, memory_order_release);
+	return 1;
+}
+
+/* like `whl_efd_init_from_eventfds()` */
+void
+whl_slots_efd_init_from_eventfds(whl_slots_efd_t *efd, whl_slots_t *slots,
+                                 int readable, int writable)
+{
+	*efd = (whl_slots_efd_t) {
+		.slots = slots,
+		.readable = readable,
+		.writable = writable,
+	};
+}
+
+/* like `whl_efd_init()` for already initialized slots
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_slots_efd_init(whl_slots_efd_t *efd, whl_slots_t *slots)
+{
+	int readable;
+	int writable;
+
+	if (__whl_efd_open(slots->is_readable, slots->is_writable,
+	                   &readable, &writable) < 0)
+		return -1;
+
+	whl_slots_efd_init_from_eventfds(efd, slots, readable, writable);
+	return 0;
+}
+
+/* closes the two eventfd file descriptors */
+void
+whl_slots_efd_close(whl_slots_efd_t *efd)
+{
+	close(efd->readable);
+	close(efd->writable);
+}
+
+/* like `whl_efd_fds()` */
+void
+whl_slots_efd_fds(whl_slots_efd_t *efd, int *readable, int *writable)
+{
+	*readable = efd->readable;
+	*writable = efd->writable;
+}
+
+/* `whl_slots_t` version of `whl_efd_make_slice()` */
+whl_offset_t
+whl_slots_efd_make_slot(whl_slots_efd_t *efd, byte **bufp)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->slots->writable_guard, ~0);
+
+	whl_offset_t offset = whl_slots_make_slot(efd->slots, bufp);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unwritable(&efd->slots->writable_state, efd->writable);
+
+	return offset;
+}
+
+/* `whl_slots_t` version of `whl_efd_share_slice()` */
+void
+whl_slots_efd_share_slot(whl_slots_efd_t *efd, whl_offset_t offset)
+{
+	atomic_store(&efd->slots->readable_guard, 0);
+
+	whl_slots_share_slot(efd->slots, offset);
+
+	/* clear errno, it may be set by __whl_efd_write */
+	errno = 0;
+
+	__whl_efd_readable(&efd->slots->readable_state, efd->readable);
+}
+
+/* `whl_slots_t` version of `whl_efd_next_shared_slice()` */
+whl_offset_t
+whl_slots_efd_next_shared_slot(whl_slots_efd_t *efd, byte **bufp)
+{
+	atomic_store(&efd->slots->readable_guard, ~0);
+
+	whl_offset_t offset = whl_slots_next_shared_slot(efd->slots, bufp);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (offset == WHL_INVALID_OFFSET)
+		__whl_efd_unreadable(&efd->slots->readable_state, efd->readable);
+
+	return offset;
+}
+
+/* `whl_slots_t` version of `whl_efd_return_slice()` */
+size_t
+whl_slots_efd_return_slot(whl_slots_efd_t *efd, whl_offset_t offset)
+{
+	/* see whl_efd_make_slice() to explain the writable_guard  */
+	atomic_store(&efd->slots->writable_guard, 0);
+
+	size_t r = whl_slots_return_slot(efd->slots, offset);
+
+	/* clear errno, it may be set by __whl_efd_read */
+	errno = 0;
+
+	if (r > 0)
+		__whl_efd_writable(&efd->slots->writable_state, efd->writable);
+
+	return r;
+}
@@ -0,0 +1,323 @@
+/* a memory wheel that writes messages to a file when it's full, instead of
+ * making the producer wait for the consumer.
+ *
+ * once the wheel is full, messages are appended to the spill file and the
+ * producer keeps appending until there's room in the wheel for a marker, a
+ * small slice with the range of the file spilled since the last marker. after
+ * that it's back to the wheel, so the consumer sees everything in the order it
+ * was made. the consumer maps each marked range of the file and reads the
+ * messages straight out of the mapping, then punches the range out of the file
+ * so it doesn't take up disk once it's read.
+ *
+ * every slice in the wheel starts with an 8 byte tag saying whether it's a
+ * message or a marker, so messages take up 8 bytes more than with `whl_t`.
+ *
+ * both ends use a `whl_t` initialized and shared like usual and a file
+ * descriptor for the same spill file opened for reading and writing, like from
+ * `open()` with O_TMPFILE sent over with `send_fd()`. define _GNU_SOURCE
+ * before including anything for `fallocate()` and include memorywheel.h before
+ * this.
+ *
+ * writer:
+ * - `whl_spill_make_slice()` and `whl_spill_share_slice()`, share each slice
+ *   before making the next
+ * - `whl_spill_flush()` when there's nothing else to make for a while, so a
+ *   marker for the last spilled messages gets into the wheel
+ *
+ * reader:
+ * - `whl_spill_next_shared_slice()` and `whl_spill_return_slice()`, return
+ *   each slice before getting the next */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* what a slice in the wheel holds, the first 8 bytes of the slice */
+typedef enum {
+	WHL_SPILL_MESSAGE = 0x0,
+	/* a `whl_spill_marker_t` follows */
+	WHL_SPILL_MARKER  = 0x1,
+} whl_spill_tag_e;
+
+/* the range of the spill file with messages spilled since the last marker,
+ * each one is a u64 size followed by the message, padded to 8 bytes */
+typedef struct {
+	u64 start;
+	u64 end;
+} whl_spill_marker_t;
+
+/* what the make and next functions return for a message in the spill file
+ * instead of the wheel, it's never a real offset */
+#define WHL_SPILL_OFFSET  (WHL_INVALID_OFFSET - 1)
+#define WHL_SPILL_TAG_SIZE sizeof(u64)
+
+#define __whl_spill_record_size(size) \
+	(sizeof(u64) + (((u64)(size) + 7) & ~(u64)7))
+
+/* only counted by the producer */
+typedef struct {
+	/* messages and bytes written to the spill file */
+	u64 spilled;
+	u64 spilled_bytes;
+	/* markers put in the wheel, each for one or more spilled messages */
+	u64 markers;
+} whl_spill_stats_t;
+
+/* one for each end, in non-shared memory */
+typedef struct {
+	whl_t            *wheel;
+	/* the spill file */
+	int               fd;
+	/* the producer's */
+	/* where the next spilled message goes in the file */
+	u64               spill_end;
+	/* messages before this are in a marker in the wheel */
+	u64               marked;
+	/* where a message from `whl_spill_make_slice()` is written before
+	 * `whl_spill_share_slice()` puts it in the file */
+	byte             *stage;
+	size_t            stage_cap;
+	size_t            staged;
+	whl_spill_stats_t stats;
+	/* the consumer's */
+	/* a mapping of the marked range being read, or NULL */
+	byte             *map;
+	size_t            map_size;
+	/* the file offset where `map` starts */
+	u64               map_start;
+	/* the next message in the range and the end of the range */
+	u64               pos;
+	u64               end;
+} whl_spill_t;
+
+/* `wheel` is an initialized wheel, `fd` the spill file.
+ *
+ * Returns 0 on success, non-zero on error. */
+int
+whl_spill_init(whl_spill_t *spill, whl_t *wheel, int fd)
+{
+	if (fd < 0)
+		return -1;
+
+	*spill = (whl_spill_t) {
+		.wheel = wheel,
+		.fd = fd,
+	};
+	return 0;
+}
+
+/* frees the producer's staging buffer and unmaps what the consumer has
+ * mapped, neither closes the spill file */
+void
+whl_spill_close(whl_spill_t *spill)
+{
+	free(spill->stage);
+	if (spill->map)
+		munmap(spill->map, spill->map_size);
+	*spill = (whl_spill_t) { .fd = -1 };
+}
+
+/* puts a marker for everything spilled since the last one in the wheel,
+ * returns non-zero if it doesn't fit */
+int
+__whl_spill_mark(whl_spill_t *spill)
+{
+	whl_offset_t offset;
+	byte        *slice;
+
+	offset = whl_make_slice(spill->wheel, &slice,
+	                        WHL_SPILL_TAG_SIZE + sizeof(whl_spill_marker_t));
+	if (offset == WHL_INVALID_OFFSET)
+		return -1;
+
+	*(u64 *)slice = WHL_SPILL_MARKER;
+	*(whl_spill_marker_t *)(slice + WHL_SPILL_TAG_SIZE) = (whl_spill_marker_t) {
+		.start = spill->marked,
+		.end = spill->spill_end,
+	};
+	whl_share_slice(spill->wheel, offset);
+
+	spill->marked = spill->spill_end;
+	spill->stats.markers++;
+	return 0;
+}
+
+/* tries to put a marker for the last spilled messages in the wheel.
+ *
+ * returns 0 if there's nothing spilled that isn't marked */
+int
+whl_spill_flush(whl_spill_t *spill)
+{
+	if (spill->marked == spill->spill_end)
+		return 0;
+
+	return __whl_spill_mark(spill);
+}
+
+/* like `whl_make_slice()` but if the wheel is full, or messages were spilled
+ * and there's no room for their marker yet, the message is spilled too. then
+ * this returns WHL_SPILL_OFFSET and *bufp points to memory the producer owns
+ * until the message is shared.
+ *
+ * there's only one buffer for a spilled message, so share each slice with
+ * `whl_spill_share_slice()` before making another, the next spilled message
+ * would be written over it.
+ *
+ * returns WHL_INVALID_OFFSET only if there's no memory for spilling */
+whl_offset_t
+whl_spill_make_slice(whl_spill_t *spill, byte **bufp, size_t size)
+{
+	whl_offset_t offset;
+	byte        *slice;
+
+	if (   whl_spill_flush(spill) == 0
+	    && (offset = whl_make_slice(spill->wheel, &slice,
+	                                WHL_SPILL_TAG_SIZE + size)) != WHL_INVALID_OFFSET) {
+		*(u64 *)slice = WHL_SPILL_MESSAGE;
+		*bufp = slice + WHL_SPILL_TAG_SIZE;
+		return offset;
+	}
+
+	if (size > spill->stage_cap) {
+		byte *stage = realloc(spill->stage, size);
+		if (stage == NULL)
+			return WHL_INVALID_OFFSET;
+		spill->stage = stage;
+		spill->stage_cap = size;
+	}
+
+	spill->staged = size;
+	*bufp = spill->stage;
+	return WHL_SPILL_OFFSET;
+}
+
+/* like `whl_share_slice()`, writes a spilled message to the file.
+ *
+ * Returns 0 on success, non-zero if writing the spill file fails, then the
+ * message is dropped. */
+int
+whl_spill_share_slice(whl_spill_t *spill, whl_offset_t offset)
+{
+	static const byte padding[8];
+
+	if (offset != WHL_SPILL_OFFSET) {
+		whl_share_slice(spill->wheel, offset);
+		return 0;
+	}
+
+	u64          size = spill->staged;
+	u64          record = __whl_spill_record_size(size);
+	struct iovec iov[] = {
+		{ .iov_base = &size, .iov_len = sizeof(size) },
+		{ .iov_base = spill->stage, .iov_len = size },
+		{ .iov_base = (void *)padding, .iov_len = record - sizeof(size) - size },
+	};
+	ssize_t      r;
+
+	do {
+		r = pwritev(spill->fd, iov, 3, spill->spill_end);
+	} while (r < 0 && errno == EINTR);
+
+	if (r != (ssize_t)record)
+		return -1;
+
+	spill->spill_end += record;
+	spill->stats.spilled++;
+	spill->stats.spilled_bytes += size;
+	return 0;
+}
+
+/* maps the range in a marker for reading, returns non-zero on error */
+int
+__whl_spill_map(whl_spill_t *spill, const whl_spill_marker_t *marker)
+{
+	u64   page = sysconf(_SC_PAGESIZE);
+	u64   start = marker->start & ~(page - 1);
+	void *map;
+
+	map = mmap(NULL, marker->end - start, PROT_READ, MAP_SHARED,
+	           spill->fd, start);
+	if (map == MAP_FAILED)
+		return -1;
+
+	spill->map = map;
+	spill->map_size = marker->end - start;
+	spill->map_start = start;
+	spill->pos = marker->start;
+	spill->end = marker->end;
+	return 0;
+}
+
+/* done with the mapped range, gives its disk space back */
+void
+__whl_spill_unmap(whl_spill_t *spill)
+{
+	munmap(spill->map, spill->map_size);
+	/* partial blocks at the ends are zeroed instead */
+	fallocate(spill->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	          spill->map_start, spill->end - spill->map_start);
+	spill->map = NULL;
+}
+
+/* like `whl_next_shared_slice()` but reads spilled messages out of the spill
+ * file when it comes to their marker, returning WHL_SPILL_OFFSET for those.
+ *
+ * returns WHL_INVALID_OFFSET if nothing is shared or on error */
+whl_offset_t
+whl_spill_next_shared_slice(whl_spill_t *spill, byte **bufp, size_t *size)
+{
+	whl_offset_t offset;
+	byte        *slice;
+	size_t       slice_size;
+
+	for (;;) {
+		if (spill->map) {
+			if (spill->pos < spill->end) {
+				byte *record = spill->map + (spill->pos - spill->map_start);
+				*size = *(u64 *)record;
+				*bufp = record + sizeof(u64);
+				return WHL_SPILL_OFFSET;
+			}
+			__whl_spill_unmap(spill);
+		}
+
+		offset = whl_next_shared_slice(spill->wheel, &slice, &slice_size);
+		if (offset == WHL_INVALID_OFFSET)
+			return WHL_INVALID_OFFSET;
+
+		if (*(u64 *)slice == WHL_SPILL_MESSAGE) {
+			*bufp = slice + WHL_SPILL_TAG_SIZE;
+			*size = slice_size - WHL_SPILL_TAG_SIZE;
+			return offset;
+		}
+
+		whl_spill_marker_t marker =
+			*(whl_spill_marker_t *)(slice + WHL_SPILL_TAG_SIZE);
+
+		/* map it before returning the marker, so it's not lost if that fails */
+		if (__whl_spill_map(spill, &marker) != 0)
+			return WHL_INVALID_OFFSET;
+
+		whl_return_slice(spill->wheel, offset);
+	}
+}
+
+/* like `whl_return_slice()` for a slice from `whl_spill_next_shared_slice()` */
+void
+whl_spill_return_slice(whl_spill_t *spill, whl_offset_t offset)
+{
+	if (offset == WHL_SPILL_OFFSET)
+		spill->pos += __whl_spill_record_size(*(u64 *)(spill->map
+		                                                + (spill->pos - spill->map_start)));
+	else
+		whl_return_slice(spill->wheel, offset);
+}
+
+/* the producer's counts so far */
+whl_spill_stats_t
+whl_spill_stats(const whl_spill_t *spill)
+{
+	return spill->stats;
+}
@@ -0,0 +1,125 @@
+/* `whl_tap_t` watches the messages going through a `whl_split_t` without being
+ * its consumer, for debugging or monitoring a running wheel from another
+ * process. it never writes to the wheel, so the producer and consumer don't
+ * know it's there and never wait on it.
+ *
+ * the tap follows positions from where it started like the consumer does and
+ * copies each message out. anything before the consumer's head might already
+ * be written over by the producer, so like a seqlock the tap checks the head
+ * again after copying and throws the copy out if the head got past it. when
+ * the tap is behind the head it skips ahead to it. so it only sees messages
+ * it gets to before the consumer returns them, a slow tap on a busy wheel sees
+ * a sample. `whl_tap_stats()` says how much it missed.
+ *
+ * it needs positions that only increase, so it's for `whl_split_t`, which is
+ * `whl_t` with WHL_SPLIT. the tap lives in the watching process's memory.
+ * include memorywheel.h before this.
+ *
+ * watcher:
+ * - `whl_tap_read()` */
+
+/* see `whl_tap_stats()` */
+typedef struct {
+	/* messages copied */
+	u64 seen;
+	/* times the tap was behind the consumer and skipped ahead */
+	u64 lapped;
+	/* copies thrown out because the consumer got past them while copying */
+	u64 torn;
+} whl_tap_stats_t;
+
+/* in non-shared memory */
+typedef struct {
+	whl_split_t    *split;
+	/* the position of the next slice to look at */
+	u64             pos;
+	/* what it last loaded from tail */
+	u64             tail;
+	whl_tap_stats_t stats;
+} whl_tap_t;
+
+/* starts watching from the next slice shared, anything shared already is
+ * skipped */
+void
+whl_tap_init(whl_tap_t *tap, whl_split_t *split)
+{
+	u64 tail = atomic_load_explicit(&split->tail, memory_order_acquire);
+
+	*tap = (whl_tap_t) {
+		.split = split,
+		.pos = tail,
+		.tail = tail,
+	};
+}
+
+/* copies the next shared slice the tap hasn't seen into `buf`, which is `cap`
+ * bytes, and puts its size in *size. it's cut short at `cap`.
+ *
+ * returns non-zero if there's nothing new shared */
+int
+whl_tap_read(whl_tap_t *tap, byte *buf, size_t cap, size_t *size)
+{
+	whl_split_t *split = tap->split;
+
+	for (;;) {
+		/* we got lapped, jump ahead to what the consumer hasn't returned */
+		u64 head = atomic_load_explicit(&split->head, memory_order_acquire);
+		if (tap->pos < head) {
+			tap->pos = head;
+			tap->stats.lapped++;
+		}
+
+		/* only look at tail if it looks like we're empty */
+		if (tap->pos >= tap->tail) {
+			tap->tail = atomic_load_explicit(&split->tail, memory_order_acquire);
+			if (tap->pos >= tap->tail)
+				return -1;
+		}
+
+		whl_slice_t *slice = __whl_split_at(split, tap->pos);
+		size_t       user_size;
+		u8           state = __whl_slice_load(slice, &user_size,
+		                                      memory_order_acquire);
+		u64          span = __whl_split_span(split, slice);
+		/* the room after the header, a header that's written over can
+		 * say anything */
+		u64          room = (split->mirrored
+		                     ? split->size
+		                     : split->size - tap->pos % split->size)
+		                    - sizeof(whl_slice_t);
+		size_t       n = user_size < cap ? user_size : cap;
+
+		if (   (state == WHL_SLICE_READABLE || state == WHL_SLICE_RETURNED)
+		    && n <= room)
+			memcpy(buf, __whl_slice_buf(slice), n);
+
+		/* like a seqlock, if the head moved past this while we were
+		 * reading then the producer might have written over it */
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&split->head, memory_order_relaxed) > tap->pos) {
+			tap->stats.torn++;
+			continue;
+		}
+
+		if (state == WHL_SLICE_PADDING) {
+			tap->pos += span;
+			continue;
+		}
+
+		/* made but not shared yet, shared out of order after it */
+		if (state != WHL_SLICE_READABLE && state != WHL_SLICE_RETURNED)
+			return -1;
+
+		tap->pos += span;
+		tap->stats.seen++;
+		*size = n;
+		return 0;
+	}
+}
+
+/* the counts so far */
+whl_tap_stats_t
+whl_tap_stats(whl_tap_t *tap)
+{
+	return tap->stats;
+}